@@ -54,6 +54,11 @@
 				When the owning object is destroyed, this mode specifies the state of the global interrupt flag will be forced
 				to the opposite value set by the owning object when created.
 				
+			- Atomic_Level< level >::Mode
+				Only masks interrupts at or below 'level' ( BASEPRI on Cortex-M3/M4, rsil level on ESP ), leaving
+				more urgent interrupts running. The level is restored when the owning object is destroyed.
+				Platforms without interrupt levels mask everything, as Atomic_RestoreState.
+				
 		Optional parameters.
 		
 			- Safe operation for Atomic_RestoreState can be gained by using a second template parameter '_Safe' or by using 
@@ -170,6 +175,9 @@
 					existing functionality as the compiler cannot disambiguate the control paths.
 						
 		Version history
+			- 1.3
+				Added Atomic_Level, for priority threshold blocks.
+				Added ATOMICBLOCK_HOST_MODEL, a simulated interrupt controller for host builds and tests.
 			- 1.2
 			
 				Now supports:
@@ -496,6 +504,99 @@
 				const uint32_t il_;
 		};
 		
+	#elif defined( ATOMICBLOCK_HOST_MODEL )
+	
+		/*********************************************************************
+			HostInterruptModel.
+				A simulated interrupt controller for host builds and tests.
+				
+				It has a global enable flag, and a mask level in the same 
+				sense as the Xtensa PS.INTLEVEL: interrupts at or below the 
+				level are held off, 15 holds off everything.
+				
+				'Trigger' raises a simulated interrupt; if it is held off it
+				is left pending, and run as soon as it is unmasked.
+		*********************************************************************/
+		
+		struct HostInterruptModel{
+			
+			typedef void ( *Handler )( void );
+			
+			bool b_Enabled;
+			uint8_t u_Level;
+			Handler h_Pending[ 16 ];
+			
+			_INLINE_ static HostInterruptModel &State( void )
+				{
+					static HostInterruptModel h_State = { true, 0, { 0 } };
+					return h_State;
+				}
+				
+			/*** Would an interrupt at 'u_Priority' ( 1 - 15 ) be held off just now? ***/
+			_INLINE_ static bool IsMasked( uint8_t u_Priority ) { return !State().b_Enabled || u_Priority <= State().u_Level; }
+			
+			_INLINE_ static void Trigger( uint8_t u_Priority, Handler h_Handler )
+				{
+					if( IsMasked( u_Priority ) ) State().h_Pending[ u_Priority & 0xf ] = h_Handler;
+					else Enter( u_Priority, h_Handler );
+				}
+			
+			/*** Run anything pending that is no longer masked, most urgent first. ***/
+			static void Service( void )
+				{
+					for( uint8_t u_Priority = 15 ; u_Priority > 0 ; --u_Priority ){
+						Handler h_Handler = State().h_Pending[ u_Priority ];
+						if( h_Handler && !IsMasked( u_Priority ) ){
+							State().h_Pending[ u_Priority ] = 0;
+							Enter( u_Priority, h_Handler );
+						}
+					}
+				}
+				
+			/*** Run a handler as the hardware would: at its own level. ***/
+			static void Enter( uint8_t u_Priority, Handler h_Handler )
+				{
+					uint8_t u_Saved = State().u_Level;
+					State().u_Level = u_Priority;
+					h_Handler();
+					State().u_Level = u_Saved;
+					Service();
+				}
+				
+			_INLINE_ static void SetLevel( uint8_t u_Level )
+				{
+					State().u_Level = u_Level;
+					Service();
+				}
+				
+			_INLINE_ static void SetEnabled( bool b_Enabled )
+				{
+					State().b_Enabled = b_Enabled;
+					if( b_Enabled ) Service();
+				}
+		};
+		
+		/*** GlobalInterrupts On/Off function prototypes must not change. ***/
+		_INLINE_ void GlobalInterruptsOff( void )					{ HostInterruptModel::SetEnabled( false ); }
+		_INLINE_ void GlobalInterruptsOn( void )					{ HostInterruptModel::SetEnabled( true ); }
+		
+		/*********************************************************************
+			Atomic_RestoreState host model specific.
+				Safe mode is unused in the host model.
+		*********************************************************************/		
+		
+		template< bool _Atomic, bool _Unused = true >
+			struct Atomic_RestoreState{
+
+				_INLINE_ Atomic_RestoreState( void ) : b_Status( HostInterruptModel::State().b_Enabled ) { ( _Atomic ? GlobalInterruptsOff : GlobalInterruptsOn )(); }
+					
+				_INLINE_ ~Atomic_RestoreState( void )					
+					{ 
+						HostInterruptModel::SetEnabled( this->b_Status );
+					}
+				const bool b_Status;
+		};
+		
 	#else
 		#error AtomicBlock does not currently support this architecture.
 	#endif	
@@ -526,6 +627,104 @@
 	
 	template< bool _Unused_A = true, bool _Unused_B = true > struct Atomic_None{};			
 	
+	
+	/*********************************************************************
+		Atomic_Level interface.
+			A priority threshold version of Atomic_RestoreState: when
+			'_Atomic' is true, only interrupts at or below '_Level' are
+			masked, so more urgent ones are never held off. When false,
+			all interrupts are unmasked. The previous level is restored
+			at the end of its life.
+			
+			The meaning of '_Level' follows the hardware:
+			
+				Cortex-M3 / Cortex-M4
+					The raw BASEPRI value ( already shifted into the
+					implemented priority bits ). Interrupts whose priority
+					value is numerically equal or greater are masked.
+					BASEPRI is only ever raised, never lowered, on entry.
+					
+				ESP8266 / ESP32
+					The rsil level ( 1 - 15 ); levels up to and including 
+					'_Level' are masked. PS.INTLEVEL is only ever raised,
+					never lowered, on entry.
+					
+				Host model
+					As ESP.
+					
+				Others
+					No priority levels; all interrupts are masked, exactly
+					as Atomic_RestoreState.
+			
+			Usage:
+				AtomicBlock< Atomic_Level< 3 >::Mode >				a_Block;
+				AtomicLevelBlock< 3 >								a_Block;
+				CircularBuffer< T, N, AtomicLevelBlock< 3 > >		c_Buffer;
+	*********************************************************************/
+	
+	template< uint8_t _Level >
+		struct Atomic_Level{
+		
+		#if defined( __arm__ ) && ( defined( __ARM_ARCH_7M__ ) || defined( __ARM_ARCH_7EM__ ) )
+		
+			_INLINE_ static void WriteBasePri( uint32_t u_Value )		{ __asm__ __volatile__ ("MSR basepri, %0" : : "r" (u_Value) : "memory" ); }
+			_INLINE_ static void WriteBasePriMax( uint32_t u_Value )	{ __asm__ __volatile__ ("MSR basepri_max, %0" : : "r" (u_Value) : "memory" ); }
+			_INLINE_ static uint32_t ReadBasePri( void )	
+				{ 	
+					uint32_t u_Return;
+					__asm__ __volatile__ ("MRS %0, basepri" : "=r" (u_Return) );
+					return u_Return;
+				}
+				
+			template< bool _Atomic, bool _Unused = true >
+				struct Mode{
+					_INLINE_ Mode( void ) : u_BASEPRI( ReadBasePri() ) { if( _Atomic ) WriteBasePriMax( _Level ); else WriteBasePri( 0 ); }
+					_INLINE_ ~Mode( void ) { WriteBasePri( this->u_BASEPRI ); }
+					const uint32_t u_BASEPRI;
+			};
+			
+		#elif defined( ARDUINO_ARCH_ESP8266 )  || defined( ARDUINO_ARCH_ESP32 ) 
+		
+			template< bool _Atomic, bool _Unused = true >
+				struct Mode{
+					_INLINE_ Mode( void ) : u_PS( RaiseLevel() ) { return; }
+					_INLINE_ ~Mode( void ) { xt_wsr_ps( this->u_PS ); }
+					
+					_INLINE_ static uint32_t RaiseLevel( void )
+						{
+							uint32_t u_State;
+							__asm__ __volatile__( "rsr %0, ps" : "=a" ( u_State ) : : "memory" );
+							
+							/*** Only ever raise INTLEVEL; an enclosing block may already mask more. ***/
+							if( _Atomic && ( u_State & 0xF ) >= _Level ) return u_State;
+							
+							__asm__ __volatile__( "rsil %0, %1" : "=a" ( u_State ) : "i" ( _Atomic ? _Level : 0 ) : "memory" );
+							return u_State;
+						}
+					const uint32_t u_PS;
+			};
+			
+		#elif defined( ATOMICBLOCK_HOST_MODEL )
+		
+			template< bool _Atomic, bool _Unused = true >
+				struct Mode{
+					_INLINE_ Mode( void ) : u_Level( HostInterruptModel::State().u_Level ) 
+						{ 
+							if( !_Atomic ) HostInterruptModel::SetLevel( 0 );
+							else if( _Level > this->u_Level ) HostInterruptModel::SetLevel( _Level );
+						}
+					_INLINE_ ~Mode( void ) { HostInterruptModel::SetLevel( this->u_Level ); }
+					const uint8_t u_Level;
+			};
+			
+		#else
+		
+			template< bool _Atomic, bool _Unused = true >
+				struct Mode : Atomic_RestoreState< _Atomic >{};
+				
+		#endif
+	};
+	
 		
 	/*********************************************************************
 		Main high-level interfaces.
@@ -589,6 +788,15 @@
 	template< template< bool, bool > class _AtomicMode > 
 		struct AtomicIf< true, _AtomicMode >{ typedef AtomicBlock< _AtomicMode > AType; };	
 		
+		
+	/*********************************************************************
+		AtomicLevelBlock helper.
+			'AtomicLevelBlock< level >' is 'AtomicBlock< Atomic_Level< level >::Mode >'.
+	*********************************************************************/
+	
+	template< uint8_t _Level >
+		using AtomicLevelBlock = AtomicBlock< Atomic_Level< _Level >::template Mode >;
+		
         
    struct UnsafeBlock 
    {
@@ -0,0 +1,191 @@
+/*
+	***********************************************************************************************************************************
+	AtomicTiming.h
+	***********************************************************************************************************************************
+
+		Instrumented atomic modes, to measure how long interrupts stay masked.
+
+		Declarable objects.
+
+			- Atomic_Timed< _Tag, _AtomicMode >::Mode
+				An _AtomicMode ( for AtomicBlock etc. ) that behaves exactly like '_AtomicMode'
+				( default Atomic_RestoreState ), but also times each atomic block from just
+				after interrupts are masked until just before they are restored.
+
+				Statistics are kept per '_Tag' type, not per call site: every atomic block
+				whose mode uses the same tag shares them, e.g. all the blocks inside one
+				CircularBuffer type. To narrow down the worst site, give the objects you
+				want to tell apart their own tags, or wrap a suspect block in an AtomicBlock
+				with a tag of its own.
+
+			- AtomicStats< _Tag >
+				Statistics for '_Tag': count, maximum and a histogram of durations, in
+				AtomicClock ticks. Histogram bucket 'n' counts durations in [ 4^n, 4^(n+1) ),
+				the last bucket everything longer.
+
+			- AtomicClock
+				The clock used:
+					Cortex-M3 / M4	DWT cycle counter; call AtomicClock::Enable() once at startup.
+					ESP8266 / ESP32	CCOUNT cycle counter.
+					Host model		steady_clock, in ns.
+					Others			micros().
+
+		Instrumentation is only compiled in when ENABLE_ATOMIC_TIMING is non-zero;
+		otherwise Atomic_Timed< _Tag, _AtomicMode >::Mode is simply '_AtomicMode' and
+		costs nothing.
+
+		Usage.
+
+			struct RxBufferTag{};
+			typedef AtomicBlock< Atomic_Timed< RxBufferTag >::Mode > RxAtomic;
+			CircularBuffer< uint8_t, 64, RxAtomic > rx;
+			...
+			Serial.println( AtomicStats< RxBufferTag >::Max() );
+
+	***********************************************************************************************************************************
+*/
+
+#ifndef HEADER_ATOMICTIMING
+	#define HEADER_ATOMICTIMING
+
+	#include "AtomicBlock.h"
+
+	#ifndef ENABLE_ATOMIC_TIMING
+		#define ENABLE_ATOMIC_TIMING 0
+	#endif
+
+	/*** Clock sources; see AtomicClock. ***/
+	#if defined( __arm__ ) && ( defined( __ARM_ARCH_7M__ ) || defined( __ARM_ARCH_7EM__ ) )
+		#define ATOMICCLOCK_DWT
+	#elif defined( ARDUINO_ARCH_ESP8266 ) || defined( ARDUINO_ARCH_ESP32 )
+		#define ATOMICCLOCK_CCOUNT
+	#elif defined( ATOMICBLOCK_HOST_MODEL )
+		#define ATOMICCLOCK_CHRONO
+		#include <chrono>
+	#else
+		#define ATOMICCLOCK_MICROS
+		#include <Arduino.h>
+	#endif
+
+
+	/*********************************************************************
+		AtomicClock interface.
+			Free running tick source for timing atomic blocks.
+	*********************************************************************/
+
+	struct AtomicClock{
+
+	#if defined( ATOMICCLOCK_DWT )
+
+		/*** DWT cycle counter. Must be enabled before use. ***/
+		_INLINE_ static void Enable( void )
+			{
+				*( volatile uint32_t* ) 0xE000EDFC |= ( 1UL << 24 );	// DEMCR.TRCENA
+				*( volatile uint32_t* ) 0xE0001004 = 0;					// DWT_CYCCNT
+				*( volatile uint32_t* ) 0xE0001000 |= 1;				// DWT_CTRL.CYCCNTENA
+			}
+		_INLINE_ static uint32_t Now( void ) { return *( volatile uint32_t* ) 0xE0001004; }
+
+	#elif defined( ATOMICCLOCK_CCOUNT )
+
+		_INLINE_ static void Enable( void ) { return; }
+		_INLINE_ static uint32_t Now( void )
+			{
+				uint32_t u_Count;
+				__asm__ __volatile__( "rsr %0, ccount" : "=a" ( u_Count ) );
+				return u_Count;
+			}
+
+	#elif defined( ATOMICCLOCK_CHRONO )
+
+		_INLINE_ static void Enable( void ) { return; }
+		_INLINE_ static uint32_t Now( void )
+			{
+				return ( uint32_t ) std::chrono::duration_cast< std::chrono::nanoseconds >(
+						std::chrono::steady_clock::now().time_since_epoch() ).count();
+			}
+
+	#else
+
+		_INLINE_ static void Enable( void ) { return; }
+		_INLINE_ static uint32_t Now( void ) { return micros(); }
+
+	#endif
+	};
+
+
+	/*********************************************************************
+		AtomicStats interface.
+			Duration statistics for one '_Tag'. Updated from inside the
+			atomic block being timed, so updates are protected; protect
+			reads yourself if they must be consistent.
+	*********************************************************************/
+
+	template< typename _Tag >
+		struct AtomicStats{
+
+			static const uint8_t BUCKETS = 8;
+
+			_INLINE_ static void Record( uint32_t u_Ticks )
+				{
+					if( u_Ticks > u_Max ) u_Max = u_Ticks;
+
+					const uint32_t u_Seen = u_Count;
+					if( u_Seen != 0xffffffff ) u_Count = u_Seen + 1;
+
+					uint8_t u_Bucket = 0;
+					while( u_Bucket < BUCKETS - 1 && ( u_Ticks >>= 2 ) ) ++u_Bucket;
+					const uint16_t u_Hits = u_Histogram[ u_Bucket ];
+					if( u_Hits != 0xffff ) u_Histogram[ u_Bucket ] = u_Hits + 1;
+				}
+
+			_INLINE_ static uint32_t Max( void )					{ return u_Max; }
+			_INLINE_ static uint32_t Count( void )					{ return u_Count; }
+			_INLINE_ static uint16_t Histogram( uint8_t u_Bucket )	{ return u_Histogram[ u_Bucket ]; }
+
+			static void Reset( void )
+				{
+					u_Max = 0;
+					u_Count = 0;
+					for( uint8_t u_Bucket = 0 ; u_Bucket < BUCKETS ; ++u_Bucket ) u_Histogram[ u_Bucket ] = 0;
+				}
+
+			static volatile uint32_t u_Max;
+			static volatile uint32_t u_Count;
+			static volatile uint16_t u_Histogram[ BUCKETS ];
+	};
+
+	template< typename _Tag > volatile uint32_t AtomicStats< _Tag >::u_Max = 0;
+	template< typename _Tag > volatile uint32_t AtomicStats< _Tag >::u_Count = 0;
+	template< typename _Tag > volatile uint16_t AtomicStats< _Tag >::u_Histogram[ AtomicStats< _Tag >::BUCKETS ] = { 0 };
+
+
+	/*********************************************************************
+		Atomic_Timed interface.
+			Wraps '_AtomicMode'; the base is constructed ( interrupts
+			masked ) before the start time is taken, and the end time
+			is recorded before the base is destroyed ( interrupts
+			restored ). Only atomic ( masking ) blocks are timed.
+	*********************************************************************/
+
+	template< typename _Tag, template< bool, bool > class _AtomicMode = Atomic_RestoreState >
+		struct Atomic_Timed{
+
+		#if ENABLE_ATOMIC_TIMING
+
+			template< bool _Atomic, bool _SafeRestore = false >
+				struct Mode : _AtomicMode< _Atomic, _SafeRestore >{
+					_INLINE_ Mode( void ) : _AtomicMode< _Atomic, _SafeRestore >(), u_Start( _Atomic ? AtomicClock::Now() : 0 ) { return; }
+					_INLINE_ ~Mode( void ) { if( _Atomic ) AtomicStats< _Tag >::Record( AtomicClock::Now() - this->u_Start ); }
+					const uint32_t u_Start;
+			};
+
+		#else
+
+			template< bool _Atomic, bool _SafeRestore = false >
+				using Mode = _AtomicMode< _Atomic, _SafeRestore >;
+
+		#endif
+	};
+
+#endif
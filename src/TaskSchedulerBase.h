@@ -1,6 +1,11 @@
 #ifndef TASK_SCHEDULER_BASE_H
 #define TASK_SCHEDULER_BASE_H
 
+/// Set to 1 to have every scheduler keep busy/idle (load) statistics
+#ifndef ENABLE_TASK_SCHEDULER_LOAD
+#define ENABLE_TASK_SCHEDULER_LOAD 0
+#endif
+
 namespace psiiot
 {
     class ATaskScheduler;
@@ -38,7 +43,7 @@ namespace psiiot
             bool enabled_;
 
         public:
-            EnableableTask(bool en=true) : enabled_(en)
+            constexpr EnableableTask(bool en=true) : enabled_(en)
             {}
 
         bool isEnabled() const { return enabled_; } 
@@ -48,64 +53,91 @@ namespace psiiot
     };
     //===================================================================
    /**
-     * Base Trait class for `TaskScheduler`.
+     * Slice timer for `TaskScheduler`.
+     *
+     * Part of every scheduler (via `ATaskScheduler`): a timer that is reset
+     * every time a slice begins (`TaskScheduler` calls `startSlice()` before
+     * the LIMIT trait's `beginSlice()`), but does not perform any other
+     * operations with it.
      *
-     * This is a mixin class that adds a timer that is reset every time
-     * a slice begins, but does not perform any other operations with it.
+     * LIMIT traits are handed it in each of their hooks, so `RunTasksTimed`
+     * (or your own trait) can monitor the execution timing.
      *
-     * Used as a base for `RunTasksTimed`, and can be mixed in if you
-     * want to monitor the execution timing.
+     * Kept as two plain words rather than a `MilliTimer`, so that it (and
+     * with it every scheduler) has a `constexpr` constructor.
      */
     class RunTasksTimerSupport
     {
         protected:
-            // Millisecond intimer
-            MilliTimer inTimer_;
+            uint32_t sliceBegin_;   ///< millis() when the slice began
+            uint32_t sliceMillis_;  ///< Slice length
 
         public:
-            RunTasksTimerSupport()
-                : inTimer_(0xffffffff, false)
+            constexpr RunTasksTimerSupport()
+                : sliceBegin_(0), sliceMillis_(0xffffffff)
             {}
 
-            void beginSlice()
+            /// (re)start the slice timer
+            void startSlice()
             {
-                inTimer_.reset();
+                sliceBegin_ = millis();
             }
 
-            bool doneSlice(TaskResult res)
-            {
-                return false;
-            }
+            /// Slice length, as enforced by `RunTasksTimed`
+            uint32_t getSliceMillis() const { return sliceMillis_; }
+            void setSliceMillis(uint32_t ms) { sliceMillis_ = ms; }
 
             /// millis() when we began the slice
-            uint32_t sliceBeginMillis() const { return inTimer_.ticksWhenReset(); }
+            uint32_t sliceBeginMillis() const { return sliceBegin_; }
 
-            bool hasSliceExpired() { return inTimer_.isExpired(); }
+            bool hasSliceExpired() { return millis() - sliceBegin_ >= sliceMillis_; }
 
             /// How long have we been going?
-            inline unsigned long sliceExpired() const {inTimer_.intervalExpired();}
+            inline unsigned long sliceExpired() const { return millis() - sliceBegin_;}
 
-            /// How long have we to go?
-            inline unsigned long sliceLeft() const {inTimer_.intervalLeft(); }
+            /// How long have we to go? 0 once the slice has overrun
+            inline unsigned long sliceLeft() const
+            {
+                uint32_t gone = millis() - sliceBegin_;
+                return gone >= sliceMillis_ ? 0 : sliceMillis_ - gone;
+            }
                 
             static const bool CAN_CONTINUE = false;
                 
     };
     //===================================================================
+    /*
+     * LIMIT traits.
+     *
+     * A LIMIT trait decides when a slice is over. They are plain classes,
+     * (no virtual functions or bases), and each provides:
+     *
+     *  - `void beginSlice(RunTasksTimerSupport& slice)`
+     *  - `bool doneSlice(TaskResult res, RunTasksTimerSupport& slice)` - `true` to end the slice
+     *  - `void endSlice(RunTasksTimerSupport& slice)`
+     *  - `uint8_t tasksLeft() const` - how many more tasks may run; 255 is unlimited
+     *
+     * Any number of them can be combined with `SchedulerTraits<...>`.
+     */
+    //===================================================================
     /**
      * Trait class for `TaskScheduler`.
      *
      * Run everything
      */
-    class RunAllTasks : public virtual RunTasksTimerSupport
+    class RunAllTasks
     {
         public:
-            void beginSlice(){}
+            void beginSlice(RunTasksTimerSupport&){}
 
-            bool doneSlice(TaskResult res)
+            bool doneSlice(TaskResult res, RunTasksTimerSupport&)
             {
                 return false;
             }
+
+            void endSlice(RunTasksTimerSupport&){}
+
+            uint8_t tasksLeft() const { return 255; }
             
     };
     //===================================================================
@@ -114,15 +146,19 @@ namespace psiiot
      *
      * Run first active only
      */
-    class RunOneTask : public virtual RunTasksTimerSupport
+    class RunOneTask
     {
         public:
-            void beginSlice(){}
+            void beginSlice(RunTasksTimerSupport&){}
 
-            bool doneSlice(TaskResult res)
+            bool doneSlice(TaskResult res, RunTasksTimerSupport&)
             {
                 return res== TaskResult::Run;
             }
+
+            void endSlice(RunTasksTimerSupport&){}
+
+            uint8_t tasksLeft() const { return 1; }
             
     };
     //===================================================================
@@ -131,21 +167,21 @@ namespace psiiot
      *
      * Run a number of tasks
      */
-    class RunNTasks : public virtual RunTasksTimerSupport
+    class RunNTasks
     {
         protected:
             uint8_t task_count_;
             uint8_t task_limit_;
 
         public:
-            RunNTasks() : task_limit_(255) {}
+            constexpr RunNTasks(uint8_t limit=255) : task_count_(255), task_limit_(limit) {}
 
-            void beginSlice()
+            void beginSlice(RunTasksTimerSupport&)
             {
                 task_count_ = task_limit_;
             }
 
-            bool doneSlice(TaskResult res)
+            bool doneSlice(TaskResult res, RunTasksTimerSupport&)
             {
                 if(res< TaskResult::Run)
                     return false;
@@ -153,6 +189,10 @@ namespace psiiot
                 return --task_count_ == 0;
             }
 
+            void endSlice(RunTasksTimerSupport&){}
+
+            uint8_t tasksLeft() const { return task_count_; }
+
             void setLimit(uint8_t limit)
             {
                 task_limit_ = limit;
@@ -169,58 +209,422 @@ namespace psiiot
     /**
      * Trait class for `TaskScheduler`.
      *
-     * Run  tasks up to a time limit
+     * Run  tasks up to a time limit (see `setSliceMillis()`)
      */
-    class RunTasksTimed : public virtual RunTasksTimerSupport
+    class RunTasksTimed
     {
-        protected:
+        public:
+            void beginSlice(RunTasksTimerSupport&){}
 
+            bool doneSlice(TaskResult res, RunTasksTimerSupport& slice)
+            {
+                return slice.hasSliceExpired();
+            }
+
+            void endSlice(RunTasksTimerSupport&){}
+
+            uint8_t tasksLeft() const { return 255; }
+
+    };
+    //===================================================================
+    /**
+     * Trait class for `TaskScheduler`.
+     *
+     * Run a number of tasks, where the number is tuned each slice
+     * to keep slices close to a target duration:
+     *
+     *  - A slice that overran the target halves the limit.
+     *  - A slice that was ended by the limit, within target, raises it by one.
+     *
+     * The limit stays within [min,max] (see `setLimitRange()`); the current
+     * value is available from `getMaxExecCount()`.
+     */
+    class RunNTasksAdaptive : public RunNTasks
+    {
+        protected:
+            uint32_t sliceBegin_;   ///< micros() at start of slice
+            uint32_t lastSlice_;    ///< us
+            uint32_t target_;       ///< us
+            uint8_t min_;
+            uint8_t max_;
 
         public:
-            RunTasksTimed()
+            constexpr RunNTasksAdaptive()
+            : RunNTasks(8), sliceBegin_(0), lastSlice_(0), target_(1000), min_(1), max_(255)
             {}
 
+            void beginSlice(RunTasksTimerSupport& slice)
+            {
+                RunNTasks::beginSlice(slice);
+                sliceBegin_ = micros();
+            }
 
-            bool doneSlice(TaskResult res)
+            void endSlice(RunTasksTimerSupport&)
             {
-                return inTimer_.isExpired();
+                lastSlice_ = micros() - sliceBegin_;
+
+                if(lastSlice_ > target_)
+                {
+                    uint8_t l = task_limit_/2;
+                    task_limit_ = l<min_ ? min_ : l;
+                }
+                else if(task_count_==0 && task_limit_<max_)
+                {
+                    // limit was what ended the slice
+                    ++task_limit_;
+                }
             }
 
+            /// Target slice duration (us)
+            uint32_t getTargetMicros() const { return target_; }
+            void setTargetMicros(uint32_t us) { target_ = us; }
+
+            void setLimitRange(uint8_t mn, uint8_t mx)
+            {
+                min_ = mn ? mn : 1;
+                max_ = mx<min_ ? min_ : mx;
+                if(task_limit_<min_)
+                    task_limit_ = min_;
+                if(task_limit_>max_)
+                    task_limit_ = max_;
+            }
+
+            /// Duration of last slice (us)
+            uint32_t lastSliceMicros() const { return lastSlice_; }
     };
     //===================================================================
-    template<class A, class B>
-    class JoinSchedulerTraits : public A, public B
+    /**
+     * Combines any number of LIMIT traits into one: the slice ends as soon
+     * as any of them says so, and `tasksLeft()` is the smallest of theirs.
+     *
+     * Composition is by plain (non-virtual) inheritance, so empty traits
+     * take no space and every hook is resolved at compile time.
+     */
+    template<class... TRAITS>
+    class SchedulerTraits
     {
-            void beginSlice()
+        public:
+            void beginSlice(RunTasksTimerSupport&) {}
+            bool doneSlice(TaskResult, RunTasksTimerSupport&) { return false; }
+            void endSlice(RunTasksTimerSupport&) {}
+            uint8_t tasksLeft() const { return 255; }
+    };
+
+    template<class A, class... REST>
+    class SchedulerTraits<A, REST...> : public A, public SchedulerTraits<REST...>
+    {
+            typedef SchedulerTraits<REST...> Rest;
+
+        public:
+            void beginSlice(RunTasksTimerSupport& slice)
             {
-                A::beginSlice();
-                B::beginSlice();
+                A::beginSlice(slice);
+                Rest::beginSlice(slice);
             }
 
-            bool doneSlice(TaskResult res)
+            bool doneSlice(TaskResult res, RunTasksTimerSupport& slice)
             {
-                return A::doneSlice(res)
-                    || B::doneSlice(res)
+                return A::doneSlice(res, slice)
+                    || Rest::doneSlice(res, slice)
                     ;
             }
+
+            void endSlice(RunTasksTimerSupport& slice)
+            {
+                A::endSlice(slice);
+                Rest::endSlice(slice);
+            }
+
+            uint8_t tasksLeft() const
+            {
+                uint8_t a = A::tasksLeft();
+                uint8_t b = Rest::tasksLeft();
+                return a<b ? a : b;
+            }
     };
     //===================================================================
+    /// Two trait version of `SchedulerTraits`, kept for existing code
+    template<class A, class B>
+    using JoinSchedulerTraits = SchedulerTraits<A, B>;
+    //===================================================================
     /**
      * Trait class for `TaskScheduler`.
      *
      * Run N tasks up to a time limit
      */
     class  RunNTasksTimed
-    : public JoinSchedulerTraits<RunNTasks,RunTasksTimed>
+    : public SchedulerTraits<RunNTasks,RunTasksTimed>
     {
     };
 
     //===================================================================
+    /**
+     * Busy/idle accounting for a scheduler.
+     *
+     * Time spent in slices where something ran counts as busy; everything
+     * else (idle slices, and time spent outside the scheduler) is idle.
+     * Every sample period the busy fraction is folded into a set of
+     * exponential moving averages, by default over 1s, 10s and 60s.
+     *
+     * Times are measured with micros(); averages are kept as fixed point
+     * fractions where `FULL` is 100%.
+     */
+    class SchedulerLoad
+    {
+        public:
+            static const uint8_t WINDOWS = 3;
+            static const uint32_t FULL = 1UL<<24;
+
+        private:
+            uint32_t windowMillis_[WINDOWS];    ///< EMA time constants
+            uint32_t avg_[WINDOWS];             ///< Busy fraction, FULL==100%
+            uint16_t sampleMillis_;             ///< How often we update the averages
+            bool primed_;                       ///< Have we seen a slice yet?
+            uint32_t sampleBegin_;              ///< micros() at start of current sample
+            uint32_t sampleBusy_;               ///< Busy us in current sample
+            uint32_t sliceBegin_;               ///< micros() at start of current slice
+            uint32_t lastSlice_;                ///< us
+            uint32_t peakSlice_;                ///< us
+
+            //------------------------------------------------
+            void sample(uint32_t elapsed)
+            {
+                uint32_t busy = sampleBusy_ < elapsed ? sampleBusy_ : elapsed;
+                int32_t load = (uint32_t)(((uint64_t)busy << 24) / elapsed);
+                uint32_t ms = elapsed / 1000;
+
+                for(uint8_t w=0; w<WINDOWS; ++w)
+                {
+                    if(ms >= windowMillis_[w])
+                        avg_[w] = load;
+                    else
+                        avg_[w] += (int64_t)(load - (int32_t)avg_[w]) * ms / windowMillis_[w];
+                }
+
+                sampleBusy_ = 0;
+                sampleBegin_ += elapsed;
+            }
+
+        public:
+            constexpr SchedulerLoad()
+            : windowMillis_{1000, 10000, 60000}, avg_(), sampleMillis_(100), primed_(false),
+              sampleBegin_(0), sampleBusy_(0), sliceBegin_(0), lastSlice_(0), peakSlice_(0)
+            {}
+
+            //------------------------------------------------
+            void beginSlice()
+            {
+                sliceBegin_ = micros();
+                if(!primed_)
+                {
+                    sampleBegin_ = sliceBegin_;
+                    primed_ = true;
+                }
+            }
+
+            //------------------------------------------------
+            void endSlice(TaskResult res)
+            {
+                uint32_t now = micros();
+                lastSlice_ = now - sliceBegin_;
+                if(lastSlice_ > peakSlice_)
+                    peakSlice_ = lastSlice_;
+
+                if(res!=TaskResult::NotRun)
+                    sampleBusy_ += lastSlice_;
+
+                uint32_t elapsed = now - sampleBegin_;
+                if(elapsed >= sampleMillis_*1000UL)
+                    sample(elapsed);
+            }
+
+            //------------------------------------------------
+            /// Load over window `w`, in percent
+            uint8_t loadPercent(uint8_t w=0) const { return (avg_[w]*100ULL + FULL/2) >> 24; }
+
+            /// Load over window `w`, as a fraction of `FULL`
+            uint32_t loadFraction(uint8_t w=0) const { return avg_[w]; }
+
+            uint32_t getWindowMillis(uint8_t w) const { return windowMillis_[w]; }
+            void setWindowMillis(uint8_t w, uint32_t ms) { windowMillis_[w] = ms ? ms : 1; }
+
+            uint16_t getSampleMillis() const { return sampleMillis_; }
+            void setSampleMillis(uint16_t ms) { sampleMillis_ = ms; }
+
+            /// Duration of the last slice (us)
+            uint32_t lastSliceMicros() const { return lastSlice_; }
+
+            /// Longest slice (us) since the last `resetPeak()`
+            uint32_t peakSliceMicros() const { return peakSlice_; }
+            void resetPeak() { peakSlice_ = 0; }
+    };
+    //===================================================================
+    /**
+     * Common base of all schedulers.
+     *
+     * Schedulers are tasks, so can be nested; while a nested scheduler is
+     * running a slice it tracks the scheduler that ran it (its parent), so
+     * that it can honour whatever is left of the parent's slice budget.
+     *
+     * Timed tasks propose the time they next need to run (deadline plus
+     * slack) with `proposeWake()`; the earliest proposal of a slice is the
+     * coalesced wake time, reported by `getNextWake()` and passed on to any
+     * parent. The following slice that reaches it is a wake slice, in which
+     * every task already past its deadline runs, slack or not.
+     */
     class ATaskScheduler
         : public EnableableTask,
-        	public virtual RunTasksTimerSupport
+        	public RunTasksTimerSupport
     {
+        protected:
+            ATaskScheduler* parent_;    ///< Scheduler running us this slice, if any
+            uint8_t tasksBudget_;       ///< Tasks we may still run, as inherited from parent_
+            uint8_t tasksRun_;          ///< Tasks run this slice, including by nested schedulers
+            uint8_t childTasks_;        ///< Tasks run by a nested scheduler we just dispatched
+            uint32_t lastSliceMillis_;  ///< Duration of our last slice
+            uint32_t nextWake_;         ///< Earliest wake proposed this slice
+            bool hasNextWake_;          ///< `nextWake_` is valid
+            bool wakeSlice_;            ///< This slice reached the last coalesced wake time
+#if ENABLE_TASK_SCHEDULER_LOAD
+            SchedulerLoad load_;
+#endif
+
+            //------------------------------------------------
+            /// Begin a slice on behalf of `parent` (which may be NULL)
+            void beginNestedSlice(ATaskScheduler* parent)
+            {
+                parent_ = parent;
+                tasksBudget_ = parent ? parent->sliceTasksLeft() : 255;
+                tasksRun_ = 0;
+                startSlice();
+                wakeSlice_ = hasNextWake_ && (int32_t)(sliceBeginMillis() - nextWake_) >= 0;
+                hasNextWake_ = false;
+#if ENABLE_TASK_SCHEDULER_LOAD
+                load_.beginSlice();
+#endif
+            }
 
+            //------------------------------------------------
+            /// Count `n` tasks run in this slice
+            void countTasksRun(uint8_t n)
+            {
+                tasksRun_ = tasksRun_ > 255-n ? 255 : tasksRun_+n;
+            }
+
+            //------------------------------------------------
+            /*!
+                Tasks run by the last task dispatched: what a nested scheduler
+                reported, otherwise 1 if it ran. Resets the report.
+             */
+            uint8_t takeTasksRun(TaskResult res)
+            {
+                uint8_t n = childTasks_ ? childTasks_ : (res!=TaskResult::NotRun ? 1 : 0);
+                childTasks_ = 0;
+                return n;
+            }
+
+            //------------------------------------------------
+            /// Account for a dispatch; `true` if the inherited budget is spent.
+            bool doneNestedSlice(TaskResult res)
+            {
+                if(!parent_)
+                    return false;
+
+                if(res==TaskResult::Run && --tasksBudget_==0)
+                    return true;
+
+                return parent_->isSliceBudgetSpent();
+            }
+
+            //------------------------------------------------
+            /// @param res  Overall result of the slice
+            void endNestedSlice(TaskResult res)
+            {
+#if ENABLE_TASK_SCHEDULER_LOAD
+                load_.endSlice(res);
+#endif
+                lastSliceMillis_ = sliceExpired();
+                if(parent_)
+                {
+                    // charge our tasks to the parent's count
+                    parent_->childTasks_ = tasksRun_;
+                    if(hasNextWake_)
+                        parent_->proposeWake(nextWake_);
+                }
+                parent_ = NULL;
+            }
+
+        public:
+            constexpr ATaskScheduler()
+            : parent_(NULL), tasksBudget_(255), tasksRun_(0), childTasks_(0), lastSliceMillis_(0),
+              nextWake_(0), hasNextWake_(false), wakeSlice_(false)
+            {}
+
+            /// How many more tasks may run in the current slice
+            virtual uint8_t sliceTasksLeft() const { return tasksBudget_; }
+
+            /// `true` if our slice time, or that of any enclosing scheduler, has run out
+            bool isSliceBudgetSpent()
+            {
+                return hasSliceExpired()
+                    || (parent_ && parent_->isSliceBudgetSpent())
+                    ;
+            }
+
+            /// Time left in our slice, limited by any enclosing scheduler
+            unsigned long sliceBudgetLeft() const
+            {
+                unsigned long left = sliceLeft();
+                if(parent_)
+                {
+                    unsigned long pl = parent_->sliceBudgetLeft();
+                    if(pl<left)
+                        left = pl;
+                }
+                return left;
+            }
+
+            /// How long (ms) our last slice took; lets a parent see what a nested scheduler used.
+            uint32_t getLastSliceMillis() const { return lastSliceMillis_; }
+
+            /// A task needs to run by `ms` (millis()); keeps the earliest.
+            void proposeWake(uint32_t ms)
+            {
+                if(!hasNextWake_ || (int32_t)(ms - nextWake_) < 0)
+                {
+                    nextWake_ = ms;
+                    hasNextWake_ = true;
+                }
+            }
+
+            /*!
+                Coalesced wake time from the last slice, e.g. for tickless idle.
+                Only complete if that slice visited every timed task.
+                @return `false` if no timed task is pending
+             */
+            bool getNextWake(uint32_t& ms) const
+            {
+                ms = nextWake_;
+                return hasNextWake_;
+            }
+
+            /// `true` if tasks in their slack window should run this slice
+            bool isWakeSlice() const
+            {
+                return wakeSlice_ || (parent_ && parent_->isWakeSlice());
+            }
+
+            /// Scheduler running us, if we are nested and mid-slice
+            ATaskScheduler* getParent() const { return parent_; }
+
+#if ENABLE_TASK_SCHEDULER_LOAD
+            /// Busy/idle statistics
+            SchedulerLoad& getLoad() { return load_; }
+            const SchedulerLoad& getLoad() const { return load_; }
+
+            /// Load in percent over load window `w` (0=1s, 1=10s, 2=60s by default)
+            uint8_t loadPercent(uint8_t w=0) const { return load_.loadPercent(w); }
+#endif
     };
 
 }
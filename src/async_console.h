@@ -0,0 +1,218 @@
+/*! @file
+    @brief Buffered console output, drained by a task
+ */
+#ifndef ASYNC_CONSOLE_H
+#define ASYNC_CONSOLE_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "circular_buffer.h"
+#include "task.h"
+
+namespace psiiot
+{
+    //===================================================================
+    /// What `AsyncConsole` does with output that doesn't fit
+    enum class ConsoleFull : uint8_t
+    {
+        /// Drop the whole write, and count the bytes
+        Drop,
+
+        /// Write straight to the port until there is room (don't use from ISRs)
+        Block
+    };
+    //===================================================================
+    /**
+     * Non-blocking console.
+     *
+     * Output is formatted into a ring buffer and returns at once; the
+     * console's task then drains the ring to the port a chunk at a time,
+     * never writing more than the port can take without blocking. It can
+     * also be drained from the port's TX-empty interrupt with `drain()`:
+     * only one drain runs at a time, and one that finds another under way
+     * returns 0 at once, so chunks always reach the port in order.
+     *
+     * It has the same `write()`/`printf()` calls as a serial port, so it can
+     * stand in for one as the `CONSOLE` used by `TRACE` and `TestTask`:
+     *
+     * @code
+     *      AsyncConsole<256, HardwareSerial> console(Serial);
+     *      #define CONSOLE console
+     *      #include "task_scheduler.h"
+     *      ...
+     *      scheduler.setTask(7, &console);     // lowest priority
+     * @endcode
+     *
+     * @tparam N        Ring size (bytes)
+     * @tparam PORT     Port type; needs `availableForWrite()` and `write(const uint8_t*, size_t)`
+     * @tparam ATOMIC   Protection for the ring; an `AtomicBlock` type if writing from ISRs
+     * @tparam LINE     Longest `printf()` output (bytes)
+     */
+    template<unsigned N, class PORT, typename ATOMIC = AtomicBlock<Atomic_RestoreState>, unsigned LINE = 64>
+    class AsyncConsole : public Task
+    {
+    public:
+        /// Largest chunk, in bytes; a drain copies through a buffer this size on the stack
+        static const uint8_t MAX_CHUNK = 32;
+
+    private:
+        CircularBuffer<char, N, ATOMIC> ring_;
+        PORT& port_;
+        ConsoleFull policy_;
+        uint8_t chunk_;         ///< Most bytes written per run
+        volatile bool draining_;
+        uint32_t dropped_;      ///< Bytes dropped
+
+        //----------------------------------------
+        static uint8_t clampChunk(uint8_t n)
+        {
+            return n==0 ? 1 : n>MAX_CHUNK ? MAX_CHUNK : n;
+        }
+
+        //----------------------------------------
+        /// Queue all of `s`, or nothing
+        bool enqueue(const char* s, size_t n)
+        {
+            ATOMIC block;
+            if(N - ring_.count() < n)
+                return false;
+            while(n--)
+                ring_.pushHeadUnsafe(*s++);
+            return true;
+        }
+
+    public:
+        //----------------------------------------
+        AsyncConsole(PORT& port, ConsoleFull policy=ConsoleFull::Drop, uint8_t chunk=16)
+        : port_(port), policy_(policy), chunk_(clampChunk(chunk)), draining_(false), dropped_(0)
+        {}
+        //----------------------------------------
+        /*!
+            Queue `n` bytes.
+            Under `ConsoleFull::Drop` a write is queued whole or not at all;
+            under `ConsoleFull::Block` one longer than the ring is queued in
+            ring-sized pieces.
+            @return `n`, or 0 if dropped
+         */
+        size_t write(const uint8_t* buf, size_t n)
+        {
+            const char* s = (const char*)buf;
+
+            if(policy_==ConsoleFull::Drop)
+            {
+                if(enqueue(s, n))
+                    return n;
+                ATOMIC block;
+                dropped_ += n;
+                return 0;
+            }
+
+            for(size_t left=n; left; )
+            {
+                size_t part = left < N ? left : N;
+                while(!enqueue(s, part))
+                    drain(chunk_, true);
+                s += part;
+                left -= part;
+            }
+            return n;
+        }
+        //----------------------------------------
+        size_t write(uint8_t c) { return write(&c, 1); }
+        size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+        //----------------------------------------
+        /// Formatted output, truncated to `LINE` bytes
+        int printf(const char* fmt, ...)
+        {
+            char line[LINE];
+            va_list args;
+            va_start(args, fmt);
+            int n = vsnprintf(line, LINE, fmt, args);
+            va_end(args);
+
+            if(n < 0)
+                return n;
+            if(n >= (int)LINE)
+                n = LINE-1;
+
+            return write((const uint8_t*)line, n);
+        }
+        //----------------------------------------
+        /*!
+            Pass up to `max` (at most `MAX_CHUNK`) queued bytes to the port.
+            @param wait     Write even if the port would block
+            @return bytes written; 0 if another drain is under way
+         */
+        unsigned drain(unsigned max, bool wait=false)
+        {
+            char buf[MAX_CHUNK];
+            if(max > sizeof(buf))
+                max = sizeof(buf);
+
+            {
+                ATOMIC block;
+                if(draining_)
+                    return 0;
+                draining_ = true;
+            }
+
+            if(!wait)
+            {
+                int room = port_.availableForWrite();
+                if(room <= 0)
+                    room = 0;
+                if((unsigned)room < max)
+                    max = room;
+            }
+
+            unsigned n = 0;
+            {
+                ATOMIC block;
+                while(n < max && ring_.popTailUnsafe(buf[n]))
+                    ++n;
+            }
+
+            // still ours until written, so a drain from an ISR can't overtake it
+            if(n)
+                port_.write((const uint8_t*)buf, n);
+
+            ATOMIC block;
+            draining_ = false;
+            return n;
+        }
+        //----------------------------------------
+        /// Write out one chunk, if the port has room
+        TaskResult run(ATaskScheduler* sch) override
+        {
+            return drain(chunk_) ? TaskResult::Run : TaskResult::NotRun;
+        }
+        //----------------------------------------
+        /// Write everything out, blocking
+        void flush()
+        {
+            while(drain(chunk_, true))
+                ;
+        }
+        //----------------------------------------
+        ConsoleFull getPolicy() const { return policy_; }
+        void setPolicy(ConsoleFull p) { policy_ = p; }
+
+        uint8_t getChunk() const { return chunk_; }
+
+        /// Bytes written per run; 1 to `MAX_CHUNK`
+        void setChunk(uint8_t n) { chunk_ = clampChunk(n); }
+
+        /// Bytes waiting to be written
+        unsigned pending() const { return ring_.count(); }
+
+        /// Bytes dropped because the ring was full
+        uint32_t getDropped() const
+        {
+            ATOMIC block;
+            return dropped_;
+        }
+    };
+    //===================================================================
+}
+#endif
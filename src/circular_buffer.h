@@ -21,6 +21,10 @@ class CircularBuffer
     T* tail_;           ///< Points last valid element
     unsigned count_;    ///< Number of stored
 
+public:
+    typedef T value_type;
+
+private:
 
     //----------------------------------------
     inline bool _isEmpty() const
@@ -0,0 +1,218 @@
+/*! @file
+    @brief Compile-time cyclic executive
+ */
+#ifndef CYCLIC_EXECUTIVE_H
+#define CYCLIC_EXECUTIVE_H
+
+#include "task.h"
+
+namespace psiiot
+{
+    //===================================================================
+    /*!
+        Describes one task of a `CyclicExecutive`.
+
+        @tparam T       Task type; must be default constructible
+        @tparam PERIOD  Release period (ms)
+        @tparam OFFSET  Release offset within the period (ms)
+        @tparam WCET    Worst case execution time (ms)
+     */
+    template<class T, uint32_t PERIOD, uint32_t OFFSET=0, uint32_t WCET=0>
+    struct Periodic
+    {
+        typedef T TaskType;
+        static constexpr uint32_t period = PERIOD;
+        static constexpr uint32_t offset = OFFSET % PERIOD;
+        static constexpr uint32_t wcet = WCET;
+    };
+    //===================================================================
+    namespace cyclic
+    {
+        constexpr uint32_t gcd(uint32_t a, uint32_t b) { return b==0 ? a : gcd(b, a%b); }
+        constexpr uint32_t lcm(uint32_t a, uint32_t b) { return a / gcd(a,b) * b; }
+
+        //---------------------------------------------------------------
+        /// Timing arithmetic over a list of `Periodic`s
+        template<class... E>
+        struct Set
+        {
+            static constexpr uint32_t hyper = 1;
+            static constexpr uint32_t frame = 0;
+            static constexpr uint32_t mask(uint32_t t, uint8_t bit) { return 0; }
+            static constexpr uint32_t load(uint32_t t) { return 0; }
+        };
+
+        template<class E, class... R>
+        struct Set<E, R...>
+        {
+            /// Hyperperiod: LCM of the periods
+            static constexpr uint32_t hyper = lcm(E::period, Set<R...>::hyper);
+
+            /// Minor frame: GCD of all periods and offsets
+            static constexpr uint32_t frame = gcd(gcd(E::period, E::offset), Set<R...>::frame);
+
+            static constexpr bool releasedAt(uint32_t t)
+            {
+                return (t + E::period - E::offset) % E::period == 0;
+            }
+
+            /// Bitmask of tasks released at time `t`
+            static constexpr uint32_t mask(uint32_t t, uint8_t bit)
+            {
+                return (releasedAt(t) ? (1UL<<bit) : 0) | Set<R...>::mask(t, bit+1);
+            }
+
+            /// Sum of WCETs of tasks released at time `t`
+            static constexpr uint32_t load(uint32_t t)
+            {
+                return (releasedAt(t) ? E::wcet : 0) + Set<R...>::load(t);
+            }
+        };
+
+        //---------------------------------------------------------------
+        /// `true` if every frame from `f` on holds its released work
+        template<class S>
+        constexpr bool fits(uint32_t f, uint32_t frames)
+        {
+            return f>=frames
+                || (S::load(f*S::frame) <= S::frame && fits<S>(f+1, frames))
+                ;
+        }
+
+        //---------------------------------------------------------------
+        template<unsigned... I> struct Indices {};
+
+        template<unsigned N, unsigned... I>
+        struct MakeIndices : MakeIndices<N-1, N-1, I...> {};
+
+        template<unsigned... I>
+        struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+        //---------------------------------------------------------------
+        /// The schedule: one release mask per minor frame
+        template<class S, class IDX> struct Table;
+
+        template<class S, unsigned... I>
+        struct Table<S, Indices<I...> >
+        {
+            static constexpr uint32_t masks[sizeof...(I)] = { S::mask(I*S::frame, 0)... };
+        };
+
+        template<class S, unsigned... I>
+        constexpr uint32_t Table<S, Indices<I...> >::masks[sizeof...(I)];
+
+        //---------------------------------------------------------------
+        template<uint8_t I> struct Slot {};
+
+        /// Holds the task objects, and dispatches them by mask
+        template<uint8_t BIT, class... E>
+        struct Store
+        {
+            inline TaskResult dispatch(uint32_t mask, ATaskScheduler* sch) { return TaskResult::NotRun; }
+            void at();
+        };
+
+        template<uint8_t BIT, class E, class... R>
+        struct Store<BIT, E, R...> : Store<BIT+1, R...>
+        {
+            typename E::TaskType task_;
+
+            using Store<BIT+1, R...>::at;
+            typename E::TaskType& at(Slot<BIT>) { return task_; }
+
+            inline TaskResult dispatch(uint32_t mask, ATaskScheduler* sch)
+            {
+                TaskResult res = TaskResult::NotRun;
+                if(mask & (1UL<<BIT))
+                    res = task_.E::TaskType::run(sch);
+
+                TaskResult r = Store<BIT+1, R...>::dispatch(mask, sch);
+                return r>res ? r : res;
+            }
+        };
+    }
+    //===================================================================
+    /**
+     * Table driven cyclic executive.
+     *
+     * The schedule is worked out at compile time from the `Periodic`
+     * descriptors: the minor frame is the GCD of all periods and offsets,
+     * and the table covers one hyperperiod (LCM of the periods). A set
+     * where the WCETs released in any frame exceed the frame length does
+     * not compile.
+     *
+     * At run time, each frame the executive runs the tasks in that frame's
+     * table entry, in declaration order, calling them non-virtually. Frames
+     * are timed as a cyclic `TimedTask` that catches up missed frames
+     * (`CatchUp::Burst`), so no release is ever lost.
+     *
+     * @code
+     *      CyclicExecutive<
+     *          Periodic<ReadAdc, 10, 0, 2>,
+     *          Periodic<Filter,  20, 5, 3>,
+     *          Periodic<Report, 100, 0, 2>
+     *      > exec;
+     *      ...
+     *      exec.start();
+     * @endcode
+     */
+    template<class... E>
+    class CyclicExecutive : public TimedTask, public cyclic::Store<0, E...>
+    {
+        typedef cyclic::Set<E...> Timing;
+
+    public:
+        static constexpr uint32_t HYPERPERIOD = Timing::hyper;
+        static constexpr uint32_t FRAME = Timing::frame;
+        static constexpr uint32_t FRAMES = HYPERPERIOD / FRAME;
+
+    private:
+        static_assert(sizeof...(E) > 0, "CyclicExecutive needs at least one task");
+        static_assert(sizeof...(E) <= 32, "CyclicExecutive supports up to 32 tasks");
+        static_assert(FRAMES <= 256, "Hyperperiod too long for the frame size; align the periods");
+        static_assert(cyclic::fits<Timing>(0, FRAMES), "Task set is not schedulable: a frame's WCET exceeds the frame length");
+
+        typedef cyclic::Table<Timing, typename cyclic::MakeIndices<FRAMES>::type> Schedule;
+
+        uint16_t frame_;    ///< Next frame to run
+
+    public:
+        //----------------------------------------
+        CyclicExecutive()
+        : TimedTask(FRAME, true, false, CatchUp::Burst), frame_(0)
+        {}
+        //----------------------------------------
+        /// Begin the schedule at frame 0, now
+        void start(uint32_t now=millis())
+        {
+            frame_ = 0;
+            resetAt(now - FRAME);
+        }
+        //----------------------------------------
+        void stop() { enabled_ = false; }
+        //----------------------------------------
+        /// The task object for entry `I`
+        template<uint8_t I>
+        auto task() -> decltype(this->at(cyclic::Slot<I>()))
+        {
+            return this->at(cyclic::Slot<I>());
+        }
+        //----------------------------------------
+        /// Release mask for frame `f`
+        static uint32_t frameMask(uint16_t f) { return Schedule::masks[f]; }
+        //----------------------------------------
+        TaskResult run(ATaskScheduler* sch) override
+        {
+            if(canRun(sch)!=TaskResult::Run)
+                return TaskResult::NotRun;
+
+            uint32_t mask = Schedule::masks[frame_];
+            if(++frame_ >= FRAMES)
+                frame_ = 0;
+
+            return this->dispatch(mask, sch);
+        }
+    };
+    //===================================================================
+}
+#endif
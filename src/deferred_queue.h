@@ -0,0 +1,103 @@
+/*! @file
+    @brief Deferred-call queue, for ISR "bottom halves"
+ */
+#ifndef DEFERRED_QUEUE_H
+#define DEFERRED_QUEUE_H
+
+#include "circular_buffer.h"
+#include "task.h"
+
+namespace psiiot
+{
+    //===================================================================
+    /// Function run later on behalf of an ISR
+    typedef void (*DeferredFn)(void* ctx, uint16_t arg);
+
+    //===================================================================
+    /// One queued call
+    struct DeferredCall
+    {
+        DeferredFn fn;
+        void* ctx;
+        uint16_t arg;
+    };
+    //===================================================================
+    /**
+     * Queue of deferred calls, drained by the queue's own task.
+     *
+     * ISRs `post()` a function, context and small argument and return; the
+     * work is then done when the task is next run by its scheduler. Nothing
+     * is allocated: the queue is a fixed `CircularBuffer` of `N` calls.
+     *
+     * Put it in the first slot of a `FromFirst` scheduler to get it run
+     * ahead of everything else.
+     *
+     * @tparam N        Queue length
+     * @tparam ATOMIC   Protection for the queue; an `AtomicBlock` type if posting from ISRs
+     */
+    template<unsigned N, typename ATOMIC = AtomicBlock<Atomic_RestoreState> >
+    class DeferredQueue : public Task
+    {
+        CircularBuffer<DeferredCall, N, ATOMIC> queue_;
+        uint8_t perSlice_;      ///< Max calls run per slice
+        uint16_t overflows_;    ///< Posts dropped because we were full
+
+    public:
+        //----------------------------------------
+        DeferredQueue(uint8_t perSlice=4)
+        : perSlice_(perSlice), overflows_(0)
+        {}
+        //----------------------------------------
+        /*!
+            Queue a call; safe from ISRs.
+            @return `false` if the queue was full and the call dropped
+         */
+        bool post(DeferredFn fn, void* ctx=NULL, uint16_t arg=0)
+        {
+            DeferredCall c;
+            c.fn = fn;
+            c.ctx = ctx;
+            c.arg = arg;
+
+            ATOMIC block;
+            if(queue_.pushHeadUnsafe(c))
+                return true;
+
+            ++overflows_;
+            return false;
+        }
+        //----------------------------------------
+        /// Run up to `perSlice` queued calls
+        TaskResult run(ATaskScheduler* sch) override
+        {
+            DeferredCall c;
+            uint8_t n = 0;
+
+            while(n < perSlice_ && queue_.popTail(c))
+            {
+                c.fn(c.ctx, c.arg);
+                ++n;
+            }
+
+            if(n==0)
+                return TaskResult::NotRun;
+
+            return TaskResult::Run;
+        }
+        //----------------------------------------
+        uint8_t getPerSlice() const { return perSlice_; }
+        void setPerSlice(uint8_t n) { perSlice_ = n ? n : 1; }
+
+        /// Calls waiting to run
+        unsigned pending() const { return queue_.count(); }
+
+        /// Posts dropped because the queue was full
+        uint16_t getOverflows() const
+        {
+            ATOMIC block;
+            return overflows_;
+        }
+    };
+    //===================================================================
+}
+#endif
@@ -0,0 +1,152 @@
+/*! @file
+    @brief Event groups: a word of condition flags tasks can wait on
+ */
+#ifndef EVENT_GROUP_H
+#define EVENT_GROUP_H
+
+#include <AtomicBlock.h>
+#include "task_scheduler.h"
+
+namespace psiiot
+{
+    /// One bit per condition
+    typedef uint16_t EventBits;
+
+    //===================================================================
+    /// How a wait mask is satisfied
+    enum class WaitFor : uint8_t
+    {
+        /// Any bit of the mask set
+        Any,
+
+        /// All bits of the mask set
+        All
+    };
+    //===================================================================
+    /**
+     * A word of condition flags ("data ready", "bus free", ...).
+     *
+     * Flags may be set and cleared from ISRs or tasks; pass an `AtomicBlock`
+     * type as `ATOMIC` if ISRs are involved.
+     */
+    template<typename ATOMIC = UnsafeBlock>
+    class EventGroup
+    {
+        volatile EventBits bits_;
+
+        //----------------------------------------
+        static inline bool satisfied(EventBits bits, EventBits mask, WaitFor mode)
+        {
+            return mode==WaitFor::All
+                ? (bits & mask) == mask
+                : (bits & mask) != 0
+                ;
+        }
+
+    public:
+        //----------------------------------------
+        constexpr EventGroup(EventBits initial=0)
+        : bits_(initial)
+        {}
+        //----------------------------------------
+        void set(EventBits mask)
+        {
+            ATOMIC block;
+            bits_ = bits_ | mask;
+        }
+        //----------------------------------------
+        void clear(EventBits mask)
+        {
+            ATOMIC block;
+            bits_ = bits_ & ~mask;
+        }
+        //----------------------------------------
+        EventBits get() const
+        {
+            ATOMIC block;
+            return bits_;
+        }
+        //----------------------------------------
+        bool test(EventBits mask, WaitFor mode=WaitFor::Any) const
+        {
+            return satisfied(get(), mask, mode);
+        }
+        //----------------------------------------
+        /*!
+            Test `mask`, and if satisfied, optionally clear the bits in it.
+            The test and clear are done as one atomic step.
+            @return `true` if satisfied
+         */
+        bool consume(EventBits mask, WaitFor mode, bool clr)
+        {
+            ATOMIC block;
+            if(!satisfied(bits_, mask, mode))
+                return false;
+            if(clr)
+                bits_ = bits_ & ~mask;
+            return true;
+        }
+    };
+    //===================================================================
+    /*! @brief DISPATCH trait
+
+        Lets a slot wait on an `EventGroup`: the task is only dispatched
+        once its any-of or all-of mask is satisfied, and the mask bits can
+        be cleared as it is woken. Slots with no wait registered are
+        dispatched as usual.
+     */
+    template<uint8_t N, typename ATOMIC = UnsafeBlock>
+    class WaitForEvents : public DispatchAll
+    {
+        static const uint8_t WAIT_ALL = 1;
+        static const uint8_t CLEAR_ON_WAKE = 2;
+
+        EventGroup<ATOMIC>* group_[N];
+        EventBits mask_[N];
+        uint8_t flags_[N];
+
+    protected:
+        constexpr WaitForEvents()
+        : group_(), mask_(), flags_()
+        {}
+
+        inline bool canDispatch(uint8_t slot)
+        {
+            EventGroup<ATOMIC>* g = group_[slot];
+            if(!g)
+                return true;
+
+            return g->consume(
+                mask_[slot],
+                (flags_[slot] & WAIT_ALL) ? WaitFor::All : WaitFor::Any,
+                flags_[slot] & CLEAR_ON_WAKE
+                );
+        }
+
+        void reset()
+        {
+            for(uint8_t i=0; i<N; ++i)
+                group_[i] = NULL;
+        }
+
+    public:
+        /*!
+            Only dispatch `slot` when `mask` is satisfied in `g`.
+            @param clearOnWake  Clear the `mask` bits when dispatching
+         */
+        void waitFor(uint8_t slot, EventGroup<ATOMIC>& g, EventBits mask,
+                        WaitFor mode=WaitFor::Any, bool clearOnWake=true)
+        {
+            group_[slot] = &g;
+            mask_[slot] = mask;
+            flags_[slot] = (mode==WaitFor::All ? WAIT_ALL : 0)
+                         | (clearOnWake ? CLEAR_ON_WAKE : 0)
+                         ;
+        }
+
+        /// Dispatch `slot` unconditionally again
+        void noWait(uint8_t slot) { group_[slot] = NULL; }
+    };
+    //===================================================================
+}
+#endif
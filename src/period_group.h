@@ -0,0 +1,119 @@
+/*! @file
+    @brief Tasks sharing one period, and one timer
+ */
+#ifndef PERIOD_GROUP_H
+#define PERIOD_GROUP_H
+
+#include "task.h"
+
+namespace psiiot
+{
+    //===================================================================
+    /**
+     * Group of tasks run at a common period, from a single shared timer.
+     *
+     * Put the group in a scheduler slot in place of its members. Each
+     * period, all members are made ready together; each is then run once
+     * its phase offset into the period has passed, so members with
+     * offset 0 sample in step, and offsets can spread the work out.
+     *
+     * Members are ordinary `Task`s with no timers of their own; they run
+     * once per period, in the order added.
+     *
+     * @code
+     *      PeriodGroup<4> every100ms(100);
+     *      every100ms.add(&tempSensor);
+     *      every100ms.add(&humiditySensor);
+     *      every100ms.add(&report, 50);    // half a period later
+     * @endcode
+     *
+     * @tparam N    Most members; up to 32
+     */
+    template<uint8_t N>
+    class PeriodGroup : public TimedTask
+    {
+        static_assert(N > 0 && N <= 32, "PeriodGroup supports 1 to 32 members");
+
+        Task* members_[N];
+        uint16_t offset_[N];    ///< ms into the period
+        uint8_t count_;
+        uint32_t pending_;      ///< Members made ready but not yet run
+        uint16_t overruns_;     ///< Periods that began with members still pending
+
+    public:
+        //----------------------------------------
+        PeriodGroup(uint32_t period, bool en=true)
+        : TimedTask(period, true, en), members_(), offset_(), count_(0), pending_(0), overruns_(0)
+        {}
+        //----------------------------------------
+        /// Add `t`, run `offset` ms into each period; `false` if full
+        bool add(Task* t, uint16_t offset=0)
+        {
+            if(count_>=N)
+                return false;
+            members_[count_] = t;
+            offset_[count_] = offset;
+            ++count_;
+            return true;
+        }
+        //----------------------------------------
+        /// Phase offset of member `i`
+        uint16_t getOffset(uint8_t i) const { return offset_[i]; }
+        void setOffset(uint8_t i, uint16_t offset) { offset_[i] = offset; }
+        //----------------------------------------
+        /// Spread members' offsets evenly over the period, in order added
+        void spread()
+        {
+            for(uint8_t i=0; i<count_; ++i)
+                offset_[i] = getInterval() * i / count_;
+        }
+        //----------------------------------------
+        uint8_t numberOfMembers() const { return count_; }
+        Task* getMember(uint8_t i) const { return members_[i]; }
+
+        /// Bit `i` set if member `i` is waiting for its offset this period
+        uint32_t pendingMask() const { return pending_; }
+
+        /// Periods that began before every member of the last had run
+        uint16_t getOverruns() const { return overruns_; }
+        //----------------------------------------
+        TaskResult run(ATaskScheduler* sch) override
+        {
+            if(canRun(sch)==TaskResult::Run)
+            {
+                if(pending_)
+                    ++overruns_;
+                pending_ = count_==32 ? 0xffffffffUL : (1UL<<count_) - 1;
+            }
+
+            if(!pending_)
+                return TaskResult::NotRun;
+
+            // the period began when the timer was last re-armed
+            const uint32_t into = sch->sliceBeginMillis() - getIntervalBeganMillis();
+            TaskResult res = TaskResult::NotRun;
+
+            for(uint8_t i=0; i<count_; ++i)
+            {
+                const uint32_t bit = 1UL<<i;
+                if(!(pending_ & bit))
+                    continue;
+
+                if(offset_[i] > into)
+                {
+                    // not due yet
+                    sch->proposeWake(getIntervalBeganMillis() + offset_[i]);
+                    continue;
+                }
+
+                pending_ &= ~bit;
+                TaskResult r = members_[i]->run(sch);
+                if(r>res)
+                    res = r;
+            }
+            return res;
+        }
+    };
+    //===================================================================
+}
+#endif
@@ -0,0 +1,149 @@
+/*! @file
+    @brief Dataflow pipeline stages joined by circular buffers
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "circular_buffer.h"
+#include "task_scheduler.h"
+
+namespace psiiot
+{
+    //===================================================================
+    /**
+     * One stage of a processing chain (acquire -> filter -> pack -> ...).
+     *
+     * The stage reads items from its input ring and writes results to its
+     * output ring, both in place. It only does work when it is ready, i.e.
+     * the input has data and the output has room; otherwise `run()` returns
+     * `NotRun` straight away, so the scheduler moves on. A full output
+     * stops the stage, which in turn leaves its input to fill up: that is
+     * the backpressure up the chain.
+     *
+     * When ready, a stage processes a batch: up to `batch` items, stopping
+     * early once the scheduler's slice budget is spent.
+     *
+     * To stop the scheduler dispatching stages that aren't ready at all,
+     * give it the `WaitForReady` DISPATCH trait and register each stage's
+     * slot with it.
+     *
+     * @tparam IN   Input `CircularBuffer` type
+     * @tparam OUT  Output `CircularBuffer` type
+     */
+    template<class IN, class OUT>
+    class PipelineStage : public EnableableTask
+    {
+    public:
+        typedef typename IN::value_type InItem;
+        typedef typename OUT::value_type OutItem;
+
+    protected:
+        IN& in_;
+        OUT& out_;
+        uint8_t batch_;     ///< Max items per run
+
+        //----------------------------------------
+        /*!
+            Process one item.
+            @param in   Input item
+            @param out  Output slot to fill
+            @return `true` if `out` was filled; `false` to drop the item
+         */
+        virtual bool process(const InItem& in, OutItem& out) = 0;
+
+    public:
+        //----------------------------------------
+        PipelineStage(IN& in, OUT& out, uint8_t batch=8)
+        : in_(in), out_(out), batch_(batch ? batch : 1)
+        {}
+        //----------------------------------------
+        /// Input has data and output has room
+        bool isReady() const
+        {
+            return enabled_ && !in_.isEmpty() && !out_.isFull();
+        }
+        //----------------------------------------
+        TaskResult run(ATaskScheduler* sch) override
+        {
+            if(!isReady())
+                return TaskResult::NotRun;
+
+            uint8_t n = 0;
+            do
+            {
+                const InItem* i = in_.peekTailElement();
+                OutItem* o = out_.peekHeadElement();
+                if(!i || !o)
+                    break;
+
+                if(process(*i, *o))
+                    out_.advanceHead();
+                in_.advanceTail();
+            }
+            while(++n < batch_ && !(sch && sch->isSliceBudgetSpent()));
+
+            return TaskResult::Run;
+        }
+        //----------------------------------------
+        uint8_t getBatch() const { return batch_; }
+        void setBatch(uint8_t n) { batch_ = n ? n : 1; }
+    };
+    //===================================================================
+    /*! @brief DISPATCH trait
+
+        Only dispatches a slot when its task's `isReady()` is true, so a
+        stage with no input or no room for output costs one inline check
+        rather than a dispatch. Slots with nothing registered are
+        dispatched as usual.
+
+        @code
+            TaskScheduler<RunAllTasks, FromFirst<3>, WaitForReady<3> > sch;
+            sch.setTask(0, &filter);
+            sch.readyWhen(0, filter);
+        @endcode
+     */
+    template<uint8_t N>
+    class WaitForReady : public DispatchAll
+    {
+        typedef bool (*ReadyFn)(const void*);
+
+        const void* obj_[N];
+        ReadyFn ready_[N];
+
+        template<class T>
+        static bool isReadyOf(const void* obj)
+        {
+            return static_cast<const T*>(obj)->isReady();
+        }
+
+    protected:
+        constexpr WaitForReady()
+        : obj_(), ready_()
+        {}
+
+        inline bool canDispatch(uint8_t slot)
+        {
+            return !ready_[slot] || ready_[slot](obj_[slot]);
+        }
+
+        void reset()
+        {
+            for(uint8_t i=0; i<N; ++i)
+                ready_[i] = NULL;
+        }
+
+    public:
+        /// Only dispatch `slot` while `t.isReady()`
+        template<class T>
+        void readyWhen(uint8_t slot, const T& t)
+        {
+            obj_[slot] = &t;
+            ready_[slot] = &isReadyOf<T>;
+        }
+
+        /// Dispatch `slot` unconditionally again
+        void noWait(uint8_t slot) { ready_[slot] = NULL; }
+    };
+    //===================================================================
+}
+#endif
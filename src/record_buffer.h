@@ -0,0 +1,253 @@
+#ifndef RECORD_BUFFER_H
+#define RECORD_BUFFER_H
+
+#include <AtomicBlock.h>
+#include <string.h>
+
+namespace psiiot
+{
+
+/**
+ * Ring buffer of variable length records (packets, log lines...).
+ *
+ * Records are stored contiguously, each behind a 2 byte length, and are
+ * never split across the end of the buffer: if a record won't fit at the
+ * end, the rest of the buffer is skipped and it goes at the start.
+ *
+ * Zero-copy on both sides:
+ *  - Producer: `reserve()` space, fill it in place, `commit()` the length used.
+ *  - Consumer: `peek()` the oldest record, use it in place, `release()` it.
+ *
+ * One producer and one consumer; either may be an ISR if `ATOMIC` is an
+ * `AtomicBlock` type, as for `CircularBuffer`.
+ */
+template<
+        unsigned N,
+        typename ATOMIC = UnsafeBlock
+        >
+class RecordBuffer
+{
+    static const uint16_t HDR = 2;          ///< Length prefix size
+    static const uint16_t WRAP = 0xffff;    ///< Length meaning "continue at the start"
+
+    uint8_t arr_[N];        ///< Storage
+    unsigned head_;         ///< Where the next record goes
+    unsigned tail_;         ///< Oldest record
+    unsigned used_;         ///< Bytes in use, including headers and skipped ends
+    unsigned records_;      ///< Number of stored records
+
+    unsigned resAt_;        ///< Producer: header position of reservation
+    unsigned resPad_;       ///< Producer: end bytes skipped to make it fit
+    uint16_t resLen_;       ///< Producer: reserved length
+
+    unsigned peekAt_;       ///< Consumer: header position of peeked record
+    unsigned peekPad_;      ///< Consumer: end bytes skipped to reach it
+
+    //----------------------------------------
+    inline uint16_t readLen(unsigned at) const
+    {
+        return arr_[at] | (arr_[at+1] << 8);
+    }
+    //----------------------------------------
+    inline void writeLen(unsigned at, uint16_t len)
+    {
+        arr_[at] = len & 0xff;
+        arr_[at+1] = len >> 8;
+    }
+
+public:
+    //----------------------------------------
+    RecordBuffer()
+    : head_(0), tail_(0), used_(0), records_(0),
+      resAt_(0), resPad_(0), resLen_(0), peekAt_(0), peekPad_(0)
+    {
+    }
+    //----------------------------------------
+    bool isEmpty() const
+    {
+        ATOMIC block;
+        return records_ == 0;
+    }
+    //----------------------------------------
+    /// Number of stored records
+    unsigned count() const
+    {
+        ATOMIC block;
+        return records_;
+    }
+    //----------------------------------------
+    /// Bytes in use, including overheads
+    unsigned used() const
+    {
+        ATOMIC block;
+        return used_;
+    }
+    //----------------------------------------
+    /// Largest record that could ever be stored
+    static unsigned maxRecord() { return N - HDR; }
+    //----------------------------------------
+    /*!
+        Reserve space for a record of up to `len` bytes.
+        @return where to write it, or NULL if there is no room
+     */
+    uint8_t* reserve(uint16_t len)
+    {
+        if(len >= WRAP)
+            return NULL;
+
+        const unsigned need = HDR + len;
+        unsigned tail, used;
+        {
+            ATOMIC block;
+            if(used_ == 0)
+            {
+                // empty: start again at 0, so any record up to maxRecord() fits.
+                // The consumer has released everything, so won't touch tail_.
+                head_ = 0;
+                tail_ = 0;
+            }
+            tail = tail_;
+            used = used_;
+        }
+
+        if(used == N)
+            return NULL;
+
+        unsigned at = head_;
+        unsigned pad = 0;
+
+        if(head_ >= tail)
+        {
+            // free space is [head_,N) then [0,tail)
+            if(N - head_ < need)
+            {
+                if(tail < need)
+                    return NULL;
+                pad = N - head_;
+                at = 0;
+            }
+        }
+        else if(tail - head_ < need)
+        {
+            return NULL;
+        }
+
+        resAt_ = at;
+        resPad_ = pad;
+        resLen_ = len;
+        return arr_ + at + HDR;
+    }
+    //----------------------------------------
+    /*!
+        Publish the last reservation.
+        @param len  Bytes actually written; at most the reserved length
+     */
+    void commit(uint16_t len)
+    {
+        if(len > resLen_)
+            len = resLen_;
+
+        if(resPad_ >= HDR)
+            writeLen(head_, WRAP);
+
+        writeLen(resAt_, len);
+
+        unsigned head = resAt_ + HDR + len;
+        if(head == N)
+            head = 0;
+
+        ATOMIC block;
+        head_ = head;
+        used_ += resPad_ + HDR + len;
+        ++records_;
+    }
+    //----------------------------------------
+    /*!
+        Get the oldest record, without removing it.
+        @param len[out] its length
+        @return the record, or NULL if empty
+     */
+    const uint8_t* peek(uint16_t& len)
+    {
+        {
+            ATOMIC block;
+            if(records_ == 0)
+                return NULL;
+        }
+
+        unsigned at = tail_;
+        unsigned pad = 0;
+
+        if(N - at < HDR || readLen(at) == WRAP)
+        {
+            pad = N - at;
+            at = 0;
+        }
+
+        peekAt_ = at;
+        peekPad_ = pad;
+        len = readLen(at);
+        return arr_ + at + HDR;
+    }
+    //----------------------------------------
+    /// Remove the record returned by the last `peek()`
+    void release()
+    {
+        unsigned len = readLen(peekAt_);
+        unsigned tail = peekAt_ + HDR + len;
+        if(tail == N)
+            tail = 0;
+
+        ATOMIC block;
+        tail_ = tail;
+        used_ -= peekPad_ + HDR + len;
+        --records_;
+    }
+    //----------------------------------------
+    /*!
+        Copy a record in.
+        Into an empty buffer, this always succeeds for `len <= maxRecord()`,
+        wherever the last record ended.
+        @return `false` if no room
+     */
+    bool push(const void* data, uint16_t len)
+    {
+        uint8_t* p = reserve(len);
+        if(!p)
+            return false;
+        memcpy(p, data, len);
+        commit(len);
+        return true;
+    }
+    //----------------------------------------
+    /*!
+        Copy the oldest record out and remove it.
+        @return its length, or -1 if empty or longer than `maxLen` (and left in place)
+     */
+    int pop(void* dst, uint16_t maxLen)
+    {
+        uint16_t len;
+        const uint8_t* p = peek(len);
+        if(!p || len > maxLen)
+            return -1;
+        memcpy(dst, p, len);
+        release();
+        return len;
+    }
+    //----------------------------------------
+    /// Discard everything; not safe against a concurrent producer or consumer
+    void clear()
+    {
+        ATOMIC block;
+        head_ = 0;
+        tail_ = 0;
+        used_ = 0;
+        records_ = 0;
+    }
+    //----------------------------------------
+};
+//==============================================================
+
+} //namespace
+
+#endif
@@ -13,16 +13,41 @@
 namespace psiiot
 {
 
+    //=========================================================
+    /**
+     * What a cyclic `TimedTask` does about periods it missed because
+     * it was activated late.
+     */
+    enum class CatchUp : uint8_t
+    {
+        /// Run once, silently skip any whole periods missed
+        Skip,
+
+        /// Run once for every missed period, back-to-back on successive slices
+        Burst,
+
+        /// Run once, and report the number of periods skipped via `missedPeriods()`
+        Coalesce
+    };
     //=========================================================
     /**
      * Class which implements one-shot and cyclic timing schemes  
      *
+     * Cyclic timers are re-armed against their ideal phase (previous deadline + period),
+     * not the time they actually ran, so the long term rate is exact.
+     *
+     * A task with slack may run up to `slack` ms after its deadline, so that
+     * the scheduler can line it up with other expiries in one wake slice.
+     *
      * @note The subclass is responsible for exiting if canRun() returbs false.
      */
     class TimedTask : public EnableableTask 
     {
     protected:
         MilliTimer runTimer_;
+        CatchUp catchUp_;
+        uint16_t missed_;   ///< Periods skipped (Coalesce) or still owed (Burst)
+        uint16_t slack_;    ///< How late (ms) we may run, to share a wakeup
 
 
         //------------------------------------------------
@@ -30,9 +55,50 @@ namespace psiiot
         void resetAt(uint32_t ticks)
         {
             enabled_ = true;
+            missed_ = 0;
             runTimer_.resetAt(ticks);
         }
 
+        //------------------------------------------------
+        /*!
+            Re-arm a cyclic timer that has expired, keeping phase.
+            @param now      millis() at the start of this slice
+         */
+        void rearm(uint32_t now)
+        {
+            const uint32_t period = runTimer_.getInterval();
+            const uint32_t deadline = runTimer_.ticksWhenReset() + period;
+
+            if(period==0)
+            {
+                // no phase to keep
+                runTimer_.resetAt(now);
+                return;
+            }
+
+            // whole periods missed beyond the one we're about to run
+            const uint32_t late = (now - deadline) / period;
+
+            switch(catchUp_)
+            {
+                case CatchUp::Burst:
+                    // next deadline may already be due; we'll run again next slice
+                    runTimer_.resetAt(deadline);
+                    missed_ = late > 0xffff ? 0xffff : late;
+                    break;
+
+                case CatchUp::Coalesce:
+                    missed_ = late > 0xffff ? 0xffff : late;
+                    runTimer_.resetAt(deadline + late*period);
+                    break;
+
+                case CatchUp::Skip:
+                default:
+                    runTimer_.resetAt(deadline + late*period);
+                    break;
+            }
+        }
+
         //------------------------------------------------
         /*!
             Call this to test if we should run or not
@@ -46,36 +112,50 @@ namespace psiiot
                 return TaskResult::NotRun;
             }
 
-            enabled_ =  !runTimer_.hadExpiredNoReset(
-            sch->sliceBeginMillis()
-            );
+            const uint32_t now = sch->sliceBeginMillis();
+            const uint32_t latest = runTimer_.ticksWhenReset() + runTimer_.getInterval() + slack_;
+
+            enabled_ =  !runTimer_.hadExpiredNoReset(now);
 
             if(enabled_)
-            return TaskResult::NotRun; // timer still running
+            {
+                // timer still running
+                sch->proposeWake(latest);
+                return TaskResult::NotRun;
+            }
+
+            if((int32_t)(now - latest) < 0 && !sch->isWakeSlice())
+            {
+                // due, but can wait for a shared wakeup
+                enabled_ = true;
+                sch->proposeWake(latest);
+                return TaskResult::NotRun;
+            }
 
             if(runTimer_.isCyclic())
             {
                 // periodic, running  & done
-                runTimer_.resetAt(sch->sliceBeginMillis());
+                rearm(now);
                 enabled_ = true; // re-enable cyclic timer
+                sch->proposeWake(runTimer_.ticksWhenReset() + runTimer_.getInterval() + slack_);
             }
 
             return TaskResult::Run;
         }        
     
     public:
-        inline TimedTask(uint32_t when, bool cyclic, bool en) 
-        : EnableableTask(en), runTimer_(when, cyclic)
+        inline TimedTask(uint32_t when, bool cyclic, bool en, CatchUp cu = CatchUp::Skip) 
+        : EnableableTask(en), runTimer_(when, cyclic), catchUp_(cu), missed_(0), slack_(0)
         { 
         }
 
         //------------------------------------------------
         
         /// How long have we been waiting?
-        inline unsigned long intervalExpired() const {runTimer_.intervalExpired();}
+        inline unsigned long intervalExpired() const { return runTimer_.intervalExpired();}
 
         /// How long have we to go?
-        inline unsigned long intervalLeft() const {runTimer_.intervalLeft(); }
+        inline unsigned long intervalLeft() const { return runTimer_.intervalLeft(); }
         
         inline uint32_t getIntervalBeganMillis() const { return runTimer_.ticksWhenReset();}
         inline uint32_t getInterval() const { return runTimer_.getInterval();}
@@ -83,6 +163,18 @@ namespace psiiot
 
         inline bool isCyclic() const { return runTimer_.isCyclic(); }
         inline void setCyclic(bool cy) { runTimer_.setCyclic(cy); }
+
+        inline uint16_t getSlack() const { return slack_; }
+        inline void setSlack(uint16_t ms) { slack_ = ms; }
+
+        inline CatchUp getCatchUp() const { return catchUp_; }
+        inline void setCatchUp(CatchUp cu) { catchUp_ = cu; missed_ = 0; }
+
+        /*!
+            For `CatchUp::Coalesce`, the number of whole periods folded into the current run;
+            for `CatchUp::Burst`, the number of runs still owed.
+         */
+        inline uint16_t missedPeriods() const { return missed_; }
     };
     //=========================================================
 }
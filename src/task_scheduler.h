@@ -8,6 +8,8 @@
 #define ENABLE_TASK_SCHEDULER_TRACE 0
 #endif
 
+// Traces go to CONSOLE; point it at an AsyncConsole (async_console.h)
+// to keep them from stalling the scheduler while the port drains.
 #if ENABLE_TASK_SCHEDULER_TRACE
 #define TRACE(x) CONSOLE.write(x)
 #define TRACEF(x, ...) CONSOLE.printf(x, __VA_ARGS__ )
@@ -16,24 +18,38 @@
 #define TRACEF(x, ...)
 #endif
 
+#include <AtomicBlock.h>
 #include "task.h"
 namespace psiiot
 {
     //===================================================================
+    /*!
+        Slots in RAM, filled in at run time with `setTask()`.
+
+        ORDER traits hand the scheduler slot pointers (`Task* const*`),
+        so an ORDER may equally walk a constant table; see `FromTable`.
+     */
     template<uint8_t N>
     class TaskList
     {
     protected:
-        TaskList()
+        constexpr TaskList()
+        : tasks_()
         {
-            memset(tasks_, 0, sizeof tasks_);
         }
 
         /// managed tasks
         Task *tasks_[N];
 
+        /// Index of slot `tpp`
+        int slotOf(Task* const* tpp) const { return tpp - tasks_; }
+
+        /// A task in `slot` did some work, taking `us` if NEEDS_TIMING
+        inline void executed(uint8_t slot, uint32_t us) {}
 
     public:
+        static const bool NEEDS_TIMING = false;
+
         unsigned numberOfTasks() const {return N; }
         Task* getTask(int n) const { return tasks_[n]; }
         void setTask(int n, Task* t) { tasks_[n] = t; }
@@ -56,17 +72,17 @@ namespace psiiot
     class FromFirst : public TaskList<N>
     {
         protected:
-        Task** getFirst()
+        Task* const* getFirst()
         {
             return this->tasks_;
         }
 
-        Task** getNext(Task** t)
+        Task* const* getNext(Task* const* t)
         {
             return ++t;
         }
 
-         inline void continueFrom(Task** here)
+         inline void continueFrom(Task* const* here)
          {
              // NOP - should never be called
          }
@@ -75,20 +91,83 @@ namespace psiiot
             static const bool CAN_CONTINUE = false;    
     };
     //===================================================================
+    /*! @brief ORDER trait
+
+        As `FromFirst`, but the slots are a constant table supplied at
+        construction, rather than filled in at run time. Declare the table
+        `const` with static storage and it is constant-initialized: no
+        startup code, and on ARM/ESP it stays in flash (AVR needs
+        PROGMEM for that, which this does not support).
+
+        The only RAM used is the table pointer. The schedulers' constructors
+        are `constexpr` too, so a global scheduler built on it is also
+        constant-initialized.
+
+        @code
+            Task* const appTasks[] = { &adc, &filter, &report };
+            TaskScheduler<RunAllTasks, FromTable<3> > sch(appTasks);
+        @endcode
+     */
+    template<uint8_t N>
+    class FromTable
+    {
+        protected:
+        Task* const* table_;
+
+        constexpr FromTable(Task* const* table)
+        : table_(table)
+        {}
+
+        Task* const* getFirst()
+        {
+            return table_;
+        }
+
+        Task* const* getNext(Task* const* t)
+        {
+            return ++t;
+        }
+
+        inline void continueFrom(Task* const* here)
+        {
+            // NOP - should never be called
+        }
+
+        int slotOf(Task* const* tpp) const { return tpp - table_; }
+
+        /// Switch to another table of `N` slots; between slices only
+        void setTable(Task* const* table) { table_ = table; }
+
+        inline void executed(uint8_t slot, uint32_t us) {}
+
+    public:
+        static const bool NEEDS_TIMING = false;
+
+        unsigned numberOfTasks() const {return N; }
+        Task* getTask(int n) const { return table_[n]; }
+
+        static const bool CAN_CONTINUE = false;
+        static const uint8_t TASK_SLOTS = N;
+    };
     //===================================================================
     template<class BASEORDER>
     class Continuable : public BASEORDER
     {
     protected:
-        Task** next_;
+        Task* const* next_;
+
+        template<typename... ARGS>
+        constexpr Continuable(ARGS... args)
+        : BASEORDER(args...), next_(NULL)
+        {}
         
-        Task** getFirst()
+        Task* const* getFirst()
         {
             if(next_)
             {
                 // if we have continuation set, use it and reset
                 // we will call continueFrom() again if we must.
-                Task** t = next_;
+                Task* const* t = next_;
                 next_ = NULL;
                 return t;
             }
@@ -96,7 +175,7 @@ namespace psiiot
             return BASEORDER::getFirst();
         }
                 
-        inline void continueFrom(Task** here)
+        inline void continueFrom(Task* const* here)
         {
             next_ = here;
         }
@@ -116,10 +195,10 @@ namespace psiiot
     class RoundRobin : public TaskList<N>
     {
         
-        Task** next_;
+        Task* const* next_;
     protected:
             
-        RoundRobin()
+        constexpr RoundRobin()
         : next_(this->tasks_)
         {
                     
@@ -131,19 +210,19 @@ namespace psiiot
                 next_ = this->tasks_;
         }
 
-        Task** getFirst()
+        Task* const* getFirst()
         {
-            Task** n = next_;
+            Task* const* n = next_;
             Increment();
             return n;
         }
 
-        inline Task** getNext(Task** t)
+        inline Task* const* getNext(Task* const* t)
         {
             return getFirst();
         }
 
-        inline void continueFrom(Task** here)
+        inline void continueFrom(Task* const* here)
         {
             next_ = here;
         }
@@ -153,11 +232,702 @@ namespace psiiot
 
     };
     //===================================================================
+    /*! @brief ORDER trait
+
+        Rate monotonic priorities: runs `TimedTask`s from the top, kept
+        sorted by period (`getInterval()`), shortest first.
+
+        Tasks are placed with `add()`, not `setTask()`. Change a period with
+        this class's `setInterval()`, which moves just that task to its new
+        place; after changing periods behind its back, call `resort()`.
+        Do either between slices. Slots are priority ranks, so per-slot
+        DISPATCH state stays with the rank, not the task.
+
+        The longest run of each task is measured, which gives the processor
+        utilisation, and a Liu-Layland check that the set will meet every
+        deadline.
+     */
+    template<uint8_t N>
+    class RateMonotonic : public TaskList<N>
+    {
+        uint32_t maxMicros_[N];     ///< Longest run seen, per slot
+        uint8_t count_;             ///< Tasks added
+
+        //----------------------------------------
+        uint32_t period(uint8_t i) const
+        {
+            return static_cast<TimedTask*>(this->tasks_[i])->getInterval();
+        }
+        //----------------------------------------
+        void swap(uint8_t a, uint8_t b)
+        {
+            Task* t = this->tasks_[a];
+            this->tasks_[a] = this->tasks_[b];
+            this->tasks_[b] = t;
+
+            uint32_t us = maxMicros_[a];
+            maxMicros_[a] = maxMicros_[b];
+            maxMicros_[b] = us;
+        }
+        //----------------------------------------
+        /// Move slot `i` to its place; everything else must be in order
+        void reposition(uint8_t i)
+        {
+            while(i>0 && period(i-1) > period(i))
+            {
+                swap(i-1, i);
+                --i;
+            }
+            while(i+1<count_ && period(i+1) < period(i))
+            {
+                swap(i, i+1);
+                ++i;
+            }
+        }
+
+    protected:
+        constexpr RateMonotonic()
+        : maxMicros_(), count_(0)
+        {}
+
+        Task* const* getFirst()
+        {
+            return this->tasks_;
+        }
+
+        Task* const* getNext(Task* const* t)
+        {
+            return ++t;
+        }
+
+        inline void continueFrom(Task* const* here)
+        {
+            // NOP - should never be called
+        }
+
+        inline void executed(uint8_t slot, uint32_t us)
+        {
+            if(us > maxMicros_[slot])
+                maxMicros_[slot] = us;
+        }
+
+    public:
+        static const bool CAN_CONTINUE = false;
+        static const bool NEEDS_TIMING = true;
+
+        void setTask(int n, Task* t) = delete;
+
+        //----------------------------------------
+        /// Add `t` at its priority; `false` if full
+        bool add(TimedTask* t)
+        {
+            if(count_>=N)
+                return false;
+            this->tasks_[count_] = t;
+            maxMicros_[count_] = 0;
+            reposition(count_++);
+            return true;
+        }
+        //----------------------------------------
+        /// Slot (priority rank) of `t`, or -1
+        int rankOf(const TimedTask* t) const
+        {
+            for(uint8_t i=0; i<count_; ++i)
+                if(this->tasks_[i]==t)
+                    return i;
+            return -1;
+        }
+        //----------------------------------------
+        /// Set the period of `t`, and move it to its new priority
+        void setInterval(TimedTask* t, uint32_t ms)
+        {
+            t->setInterval(ms);
+            int i = rankOf(t);
+            if(i>=0)
+                reposition(i);
+        }
+        //----------------------------------------
+        /// Sort all tasks by period again
+        void resort()
+        {
+            for(uint8_t i=1; i<count_; ++i)
+                for(uint8_t j=i; j>0 && period(j-1) > period(j); --j)
+                    swap(j-1, j);
+        }
+        //----------------------------------------
+        /// Longest run (us) seen of the task in `slot`
+        uint32_t getExecMicros(uint8_t slot) const { return maxMicros_[slot]; }
+
+        void resetExecTimes()
+        {
+            for(uint8_t i=0; i<N; ++i)
+                maxMicros_[i] = 0;
+        }
+        //----------------------------------------
+        /// Sum of (longest run / period) over tasks with a period, in 1/1000;
+        /// each term is rounded up, so it never under-reports
+        uint32_t utilisationPermille() const
+        {
+            uint32_t u = 0;
+            for(uint8_t i=0; i<count_; ++i)
+                if(period(i))
+                    u += (maxMicros_[i] + period(i) - 1) / period(i);  // us/ms = permille
+            return u;
+        }
+        //----------------------------------------
+        /// Liu-Layland bound n(2^(1/n)-1) for `n` tasks, in 1/1000, rounded down
+        static uint16_t boundPermille(uint8_t n)
+        {
+            static const uint16_t bound[] = {
+                1000, 1000, 828, 779, 756, 743, 734, 728, 724,
+                720, 717, 715, 713, 711, 710, 709, 708
+                };
+            return n < sizeof(bound)/sizeof(bound[0]) ? bound[n] : 693;
+        }
+        //----------------------------------------
+        /*!
+            Liu-Layland test on the measured run times: if `true`, every task
+            meets its deadlines. A `false` is not conclusive.
+         */
+        bool isSchedulable() const
+        {
+            uint8_t n = 0;
+            for(uint8_t i=0; i<count_; ++i)
+                if(period(i))
+                    ++n;
+            return utilisationPermille() <= boundPermille(n);
+        }
+    };
+    //===================================================================
+    /*! @brief DISPATCH trait
+
+        Decides, slot by slot, whether a task may be dispatched, and is told
+        the outcome afterwards. This default dispatches everything and
+        compiles away to nothing. It is also the base of the other DISPATCH
+        traits, which override only the hooks they use.
+
+        Slots a policy has demoted are normally skipped in the main pass; the
+        scheduler runs one of them (see `nextDemoted()`) only in a slice
+        where nothing else ran.
+
+        A policy may also boost a task: `boostAt()` names a slot to run in
+        place of the one the scheduler has reached.
+     */
+    class DispatchAll
+    {
+    protected:
+        inline bool canDispatch(uint8_t slot) { return true; }
+
+        /// @param us   How long the task ran, if NEEDS_TIMING, otherwise 0
+        inline void dispatched(uint8_t slot, TaskResult res, uint32_t us) {}
+
+        /// Next demoted slot to run in the background, or -1
+        inline int nextDemoted() { return -1; }
+
+        /// Slot to run in place of `slot`, bypassing `canDispatch()`, or -1
+        inline int boostAt(uint8_t slot) { return -1; }
+
+        /// May `slot`, which just returned `RunContinue`, be continued from?
+        inline bool allowContinue(uint8_t slot) { return true; }
+
+        /// Forget everything held per slot, as the slots now hold other tasks
+        inline void reset() {}
+
+    public:
+        static const bool NEEDS_TIMING = false;
+    };
+    //===================================================================
+    /// What `DemoteHogs` does with a task that keeps overrunning its budget
+    enum class HogPolicy : uint8_t
+    {
+        /// Just count violations
+        Record,
+
+        /// Only run it in otherwise idle slices, until it behaves
+        Demote
+    };
+    //===================================================================
+    /*! @brief DISPATCH trait
+
+        Gives each slot an execution budget, checked after every dispatch.
+
+        A run over budget is a violation, and earns the slot a strike; a run
+        that did work within budget removes one. Under `HogPolicy::Demote`, a
+        slot reaching the strike limit is demoted to the background: it is
+        then dispatched in slices where nothing else ran, until its strikes
+        are worked off again.
+
+        So that a busy system can't starve it, a demoted slot is also let
+        through once every `backgroundEvery` times the scheduler reaches it
+        (default 8), i.e. it keeps at least that share of its normal rate.
+        Set 0 to only ever run it in idle slices, at the risk of starving it.
+     */
+    template<uint8_t N>
+    class DemoteHogs : public DispatchAll
+    {
+        uint16_t budget_[N];        ///< ms, 0 = unchecked
+        uint8_t strikes_[N];
+        bool demoted_[N];
+        uint8_t passed_[N];         ///< Times passed over while demoted
+        uint16_t violations_;
+        uint32_t worst_;            ///< Longest overrun (us)
+        uint8_t strikeLimit_;
+        HogPolicy policy_;
+        uint8_t bgNext_;            ///< Where to look for the next background run
+        uint8_t bgEvery_;           ///< Let a demoted slot through every this many passes; 0 = never
+
+    protected:
+        constexpr DemoteHogs()
+        : budget_(), strikes_(), demoted_(), passed_(), violations_(0), worst_(0), strikeLimit_(3),
+          policy_(HogPolicy::Demote), bgNext_(0), bgEvery_(8)
+        {}
+
+        inline bool canDispatch(uint8_t slot)
+        {
+            if(!demoted_[slot])
+                return true;
+            return bgEvery_ && ++passed_[slot] >= bgEvery_;
+        }
+
+        void dispatched(uint8_t slot, TaskResult res, uint32_t us)
+        {
+            passed_[slot] = 0;
+            if(budget_[slot]==0)
+                return;
+
+            if(us > budget_[slot]*1000UL)
+            {
+                ++violations_;
+                if(us > worst_)
+                    worst_ = us;
+                if(strikes_[slot] < 255)
+                    ++strikes_[slot];
+                if(policy_==HogPolicy::Demote && strikes_[slot] >= strikeLimit_)
+                    demoted_[slot] = true;
+            }
+            else if(res!=TaskResult::NotRun && strikes_[slot])
+            {
+                if(--strikes_[slot]==0)
+                    demoted_[slot] = false;
+            }
+        }
+
+        int nextDemoted()
+        {
+            for(uint8_t i=0; i<N; ++i)
+            {
+                uint8_t s = bgNext_;
+                if(++bgNext_ >= N)
+                    bgNext_ = 0;
+                if(demoted_[s])
+                    return s;
+            }
+            return -1;
+        }
+
+        void reset()
+        {
+            for(uint8_t i=0; i<N; ++i)
+            {
+                budget_[i] = 0;
+                strikes_[i] = 0;
+                demoted_[i] = false;
+                passed_[i] = 0;
+            }
+            bgNext_ = 0;
+        }
+
+    public:
+        static const bool NEEDS_TIMING = true;
+
+        /// Set budget for `slot` in ms; 0 disables checking
+        void setBudget(uint8_t slot, uint16_t ms) { budget_[slot] = ms; }
+        uint16_t getBudget(uint8_t slot) const { return budget_[slot]; }
+
+        HogPolicy getHogPolicy() const { return policy_; }
+        void setHogPolicy(HogPolicy p) { policy_ = p; }
+
+        /// Strikes before a slot is demoted
+        void setStrikeLimit(uint8_t n) { strikeLimit_ = n ? n : 1; }
+
+        /// Dispatch a demoted slot every `n`th time it is reached; 0 = only in idle slices
+        void setBackgroundEvery(uint8_t n) { bgEvery_ = n; }
+        uint8_t getBackgroundEvery() const { return bgEvery_; }
+
+        uint8_t getStrikes(uint8_t slot) const { return strikes_[slot]; }
+        bool isDemoted(uint8_t slot) const { return demoted_[slot]; }
+
+        /// Restore a slot to normal dispatch
+        void pardon(uint8_t slot) { strikes_[slot] = 0; demoted_[slot] = false; passed_[slot] = 0; }
+
+        /// Total over-budget runs
+        uint16_t getViolations() const { return violations_; }
+
+        /// Longest over-budget run seen (us)
+        uint32_t getWorstOverrun() const { return worst_; }
+    };
+    //===================================================================
+    /*! @brief DISPATCH trait
+
+        Polls tasks that keep returning `TaskResult::NotRun` less often.
+
+        Once a slot has been idle for `threshold` dispatches in a row, it is
+        skipped for 1, then 3, 7, 15... slices after each further idle run,
+        up to 2^maxShift-1. The first run that does work, or a `notify()`,
+        puts it straight back to full rate.
+     */
+    template<uint8_t N>
+    class BackoffIdle : public DispatchAll
+    {
+        uint8_t idle_[N];       ///< Consecutive NotRun results
+        uint8_t skip_[N];       ///< Slices still to skip
+        uint8_t threshold_;
+        uint8_t maxShift_;
+
+    protected:
+        constexpr BackoffIdle()
+        : idle_(), skip_(), threshold_(4), maxShift_(6)
+        {}
+
+        inline bool canDispatch(uint8_t slot)
+        {
+            if(skip_[slot]==0)
+                return true;
+
+            --skip_[slot];
+            return false;
+        }
+
+        inline void dispatched(uint8_t slot, TaskResult res, uint32_t us)
+        {
+            if(res!=TaskResult::NotRun)
+            {
+                idle_[slot] = 0;
+                return;
+            }
+
+            if(idle_[slot] < 255)
+                ++idle_[slot];
+
+            if(idle_[slot] >= threshold_)
+            {
+                uint8_t shift = idle_[slot] - threshold_ + 1;
+                if(shift > maxShift_)
+                    shift = maxShift_;
+                skip_[slot] = (1U<<shift) - 1;
+            }
+        }
+
+        void reset()
+        {
+            for(uint8_t i=0; i<N; ++i)
+                notify(i);
+        }
+
+    public:
+        /// Restore `slot` to full rate, e.g. because it has work
+        void notify(uint8_t slot)
+        {
+            idle_[slot] = 0;
+            skip_[slot] = 0;
+        }
+
+        /// Idle runs before backing off
+        void setThreshold(uint8_t n) { threshold_ = n ? n : 1; }
+
+        /// Longest backoff is 2^shift-1 slices; at most 7
+        void setMaxShift(uint8_t shift) { maxShift_ = shift>7 ? 7 : shift; }
+
+        /// Slices `slot` will still be skipped
+        uint8_t getBackoff(uint8_t slot) const { return skip_[slot]; }
+    };
+    //===================================================================
+    /**
+     * Something tasks need exclusive use of, such as a bus, over several
+     * runs. A task calls `tryAcquire()` before starting on it, and
+     * `release()` when done.
+     *
+     * See `PriorityCeiling` for arbitration between the tasks that use it.
+     */
+    class SharedResource
+    {
+        template<uint8_t N> friend class PriorityCeiling;
+
+        static const uint8_t NONE = 0xff;
+
+        bool held_;
+        uint8_t holder_;    ///< Slot of the holder, once known
+        uint8_t ceiling_;   ///< Highest priority (lowest) slot of any user
+
+    public:
+        constexpr SharedResource()
+        : held_(false), holder_(NONE), ceiling_(NONE)
+        {}
+
+        /// `true` if we now hold it; `false` if someone else does
+        bool tryAcquire()
+        {
+            if(held_)
+                return false;
+            held_ = true;
+            return true;
+        }
+
+        void release()
+        {
+            held_ = false;
+            holder_ = NONE;
+        }
+
+        bool isHeld() const { return held_; }
+
+        /// Slot of the holder, or -1 if free (or not yet known)
+        int getHolder() const { return holder_==NONE ? -1 : holder_; }
+
+        /// Slot of the highest priority user, or -1 if none registered
+        int getCeiling() const { return ceiling_==NONE ? -1 : ceiling_; }
+    };
+    //===================================================================
+    /*! @brief DISPATCH trait
+
+        Priority ceiling arbitration of `SharedResource`s, for schedulers
+        whose slot order is their priority (e.g. `FromFirst`).
+
+        Register each slot that uses a resource with `uses()`; the lowest
+        such slot is the resource's ceiling. While the resource is held, its
+        users are not dispatched (at the cost of one test each), and the
+        holder is run in the ceiling slot's place instead, ahead of every
+        task of lower priority than any user. So a low priority holder
+        finishes quickly, and a high priority user is blocked for at most
+        the holder's remaining runs.
+
+        The holder is the registered slot that was running when the resource
+        was acquired. A boosted run bypasses the other DISPATCH policies.
+     */
+    template<uint8_t N>
+    class PriorityCeiling : public DispatchAll
+    {
+        SharedResource* uses_[N];
+
+    protected:
+        constexpr PriorityCeiling()
+        : uses_()
+        {}
+
+        inline bool canDispatch(uint8_t slot)
+        {
+            SharedResource* r = uses_[slot];
+            return !r || !r->held_;
+        }
+
+        inline void dispatched(uint8_t slot, TaskResult res, uint32_t us)
+        {
+            SharedResource* r = uses_[slot];
+            if(r && r->held_ && r->holder_==SharedResource::NONE)
+                r->holder_ = slot;
+        }
+
+        inline int boostAt(uint8_t slot)
+        {
+            SharedResource* r = uses_[slot];
+            if(r && r->held_ && r->ceiling_==slot && r->holder_!=SharedResource::NONE)
+                return r->holder_;
+            return -1;
+        }
+
+        void reset()
+        {
+            // the resources' ceilings and holders were our slots
+            for(uint8_t i=0; i<N; ++i)
+            {
+                if(uses_[i])
+                {
+                    uses_[i]->ceiling_ = SharedResource::NONE;
+                    uses_[i]->holder_ = SharedResource::NONE;
+                }
+                uses_[i] = NULL;
+            }
+        }
+
+    public:
+        /// `slot` uses `r`; a slot uses at most one resource
+        void uses(uint8_t slot, SharedResource& r)
+        {
+            uses_[slot] = &r;
+            if(r.ceiling_==SharedResource::NONE || slot < r.ceiling_)
+                r.ceiling_ = slot;
+        }
+    };
+    //===================================================================
+    /*! @brief DISPATCH trait
+
+        Bounds how long a task can keep the scheduler to itself by returning
+        `RunContinue`.
+
+        Each slot may be given a limit on consecutive continuations and/or
+        on the time (ms) since its first continuation. A continuation past
+        either limit is a violation: it is refused, so the slice carries on
+        as though the task had returned `Run`, the slot is skipped for one
+        round so the other tasks get a turn, and the violation is counted.
+     */
+    template<uint8_t N>
+    class BoundContinuation : public DispatchAll
+    {
+        static const uint8_t NONE = 0xff;
+
+        uint8_t maxRuns_[N];    ///< 0 = unlimited
+        uint16_t maxMs_[N];     ///< 0 = unlimited
+        bool skip_[N];          ///< Sit out the next round
+        uint8_t slot_;          ///< Slot continuing, or NONE
+        uint8_t runs_;          ///< Its consecutive continuations
+        uint32_t since_;        ///< millis() at its first continuation
+        uint16_t violations_;
+
+    protected:
+        constexpr BoundContinuation()
+        : maxRuns_(), maxMs_(), skip_(), slot_(NONE), runs_(0), since_(0), violations_(0)
+        {}
+
+        inline bool canDispatch(uint8_t slot)
+        {
+            if(!skip_[slot])
+                return true;
+
+            skip_[slot] = false;
+            return false;
+        }
+
+        inline void dispatched(uint8_t slot, TaskResult res, uint32_t us)
+        {
+            if(slot==slot_ && res!=TaskResult::RunContinue)
+                slot_ = NONE;
+        }
+
+        bool allowContinue(uint8_t slot)
+        {
+            if(slot!=slot_)
+            {
+                slot_ = slot;
+                runs_ = 0;
+                since_ = millis();
+            }
+
+            if(runs_ < 255)
+                ++runs_;
+
+            if((maxRuns_[slot] && runs_ > maxRuns_[slot])
+                || (maxMs_[slot] && millis() - since_ > maxMs_[slot]))
+            {
+                ++violations_;
+                skip_[slot] = true;
+                slot_ = NONE;
+                return false;
+            }
+            return true;
+        }
+
+        void reset()
+        {
+            for(uint8_t i=0; i<N; ++i)
+            {
+                maxRuns_[i] = 0;
+                maxMs_[i] = 0;
+                skip_[i] = false;
+            }
+            slot_ = NONE;
+        }
+
+    public:
+        /*!
+            Limit continuations of `slot`.
+            @param runs Max consecutive continuations; 0 = unlimited
+            @param ms   Max time since the first continuation; 0 = unlimited
+         */
+        void setContinueLimit(uint8_t slot, uint8_t runs, uint16_t ms=0)
+        {
+            maxRuns_[slot] = runs;
+            maxMs_[slot] = ms;
+        }
+
+        /// Continuations refused
+        uint16_t getViolations() const { return violations_; }
+    };
+    //===================================================================
+    /**
+     * Combines any number of DISPATCH traits into one: a slot is
+     * dispatched only if every trait allows it (asked in order, stopping at
+     * the first refusal), and every trait is told the outcome.
+     *
+     * Put traits with side effects in `canDispatch()` (e.g. `WaitForEvents`
+     * clearing flags) last.
+     */
+    template<class... POLICIES>
+    class DispatchPolicies : public DispatchAll
+    {
+    };
+
+    template<class P>
+    class DispatchPolicies<P> : public P
+    {
+    };
+
+    // every trait is already a DispatchAll, so listing it adds nothing
+    template<class Q, class... REST>
+    class DispatchPolicies<DispatchAll, Q, REST...> : public DispatchPolicies<Q, REST...>
+    {
+    };
+
+    template<class P, class... REST>
+    class DispatchPolicies<P, REST...> : public P, public DispatchPolicies<REST...>
+    {
+        typedef DispatchPolicies<REST...> Rest;
+
+    protected:
+        inline bool canDispatch(uint8_t slot)
+        {
+            return P::canDispatch(slot) && Rest::canDispatch(slot);
+        }
+
+        inline void dispatched(uint8_t slot, TaskResult res, uint32_t us)
+        {
+            P::dispatched(slot, res, us);
+            Rest::dispatched(slot, res, us);
+        }
+
+        inline int nextDemoted()
+        {
+            int s = P::nextDemoted();
+            return s>=0 ? s : Rest::nextDemoted();
+        }
+
+        inline int boostAt(uint8_t slot)
+        {
+            int s = P::boostAt(slot);
+            return s>=0 ? s : Rest::boostAt(slot);
+        }
+
+        inline bool allowContinue(uint8_t slot)
+        {
+            return P::allowContinue(slot) && Rest::allowContinue(slot);
+        }
+
+        inline void reset()
+        {
+            P::reset();
+            Rest::reset();
+        }
+
+    public:
+        static const bool NEEDS_TIMING = P::NEEDS_TIMING || Rest::NEEDS_TIMING;
+    };
+    //===================================================================
     /**
      * Scheduler that can execute up to 255 other tasks.
      *
      * It is *also* a task itself, so you can  cascade them
-     * if you enjoy complexity.
+     * if you enjoy complexity. A nested scheduler ends its slice when
+     * its parent's slice time or task count runs out, and records how long
+     * it took (`getLastSliceMillis()`).
      *
      * Tasks are scheduled in index order, until the condition
      * supplied by the KIND trait is met.
@@ -168,19 +938,63 @@ namespace psiiot
      *
      * @tparm N         Number of tasks we support
      * @tparam LIMIT    Run limit algorithm; determines how many slots get run before we pass
-     *                  control back. One of RunOneTask, RunAllTasks, RunNTasks (etc)
-     * @tparam ORDER    Determine task ordering; currently we have `FromFirst` and `RoundRobin`
+     *                  control back. One of RunOneTask, RunAllTasks, RunNTasks, RunNTasksAdaptive (etc),
+     *                  or several combined with `SchedulerTraits<...>`
+     * @tparam ORDER    Determine task ordering; currently we have `FromFirst`, `FromTable`, `RoundRobin`
+     *                  and `RateMonotonic`
+     * @tparam DISPATCH Per-slot dispatch policy; `DispatchAll`, `DemoteHogs`, `BackoffIdle`, `PriorityCeiling`,
+     *                  `BoundContinuation` (etc),
+     *                  or several combined with `DispatchPolicies<...>`
      */
     template<
         class LIMIT,
-        class ORDER
+        class ORDER,
+        class DISPATCH = DispatchAll
         >
-    class TaskScheduler : public ATaskScheduler, public LIMIT, public ORDER
+    class TaskScheduler : public ATaskScheduler, public LIMIT, public ORDER, public DISPATCH
     {
         //----------------------------------------------------
-        int taskIndex(Task **tpp)
+        int taskIndex(Task* const* tpp)
+        {
+            return ORDER::slotOf(tpp);
+        }
+
+        //----------------------------------------------------
+        /*!
+            Run one task, keeping DISPATCH informed
+            @param tasks[out]   Tasks that ran: 0 or 1, or more for a nested scheduler
+         */
+        inline TaskResult dispatch(Task* tp, uint8_t slot, uint8_t& tasks)
+        {
+            const bool timing = DISPATCH::NEEDS_TIMING || ORDER::NEEDS_TIMING;
+            uint32_t t0 = timing ? micros() : 0;
+            TaskResult tres = tp->run(this);
+            uint32_t us = timing ? micros()-t0 : 0;
+            DISPATCH::dispatched(slot, tres, us);
+            if(tres!=TaskResult::NotRun)
+                ORDER::executed(slot, us);
+            tasks = takeTasksRun(tres);
+            countTasksRun(tasks);
+            return tres;
+        }
+
+        //----------------------------------------------------
+        /// Give one demoted task a go, in an otherwise idle slice
+        TaskResult runDemoted()
         {
-            return tpp- this->tasks_;
+            int slot = DISPATCH::nextDemoted();
+            if(slot<0)
+                return TaskResult::NotRun;
+
+            Task* tp = ORDER::getTask(slot);
+            if(!tp)
+                return TaskResult::NotRun;
+
+            uint8_t tasks;
+            TaskResult tres = dispatch(tp, slot, tasks);
+            TRACEF("SCH bg %d --> %s\n", slot, toString(tres) );
+            // it doesn't get to continue from the background
+            return tres==TaskResult::RunContinue ? TaskResult::Run : tres;
         }
 
         
@@ -199,46 +1013,86 @@ namespace psiiot
          * @param intimeLimit No of ms to spend in a slice.
          * @param maxExec Max number of tasks to run in a slice
          */
-        TaskScheduler()
+        constexpr TaskScheduler()
+        {}
+
+        /// Passes `args` on to the ORDER trait (e.g. `FromTable`'s table)
+        template<typename A, typename... ARGS>
+        constexpr explicit TaskScheduler(A a, ARGS... args)
+        : ORDER(a, args...)
         {}
 
     //bool canRun() { return KIND::canRun(); }
     //----------------------------------------------------
+    uint8_t sliceTasksLeft() const override
+    {
+        uint8_t n = LIMIT::tasksLeft();
+        return n<tasksBudget_ ? n : tasksBudget_;
+    }
+    //----------------------------------------------------
     /**
      * Do the scheduling.
      *
      * Put a call to this in loop() for the main scheduler(s)
+     *
+     * @param sch   Parent scheduler if nested, otherwise NULL
      */
-    TaskResult run(ATaskScheduler* /*sch*/ ) override
+    TaskResult run(ATaskScheduler* sch) override
     {
         if(!enabled_ )
             return TaskResult::NotRun;
 
-        LIMIT::beginSlice();
-        Task **tpp = ORDER::getFirst();
+        beginNestedSlice(sch);
+        LIMIT::beginSlice(*this);
+        Task* const* tpp = ORDER::getFirst();
         TRACEF("SCH begin @%d\n", taskIndex(tpp) );
         TaskResult res = TaskResult::NotRun;
         for (int t = 0; t < ORDER::TASK_SLOTS; t++)
         {
             Task *tp = *tpp;
-            if (tp )
+            int slot = taskIndex(tpp);
+            int boost = DISPATCH::boostAt(slot);
+            if(boost>=0)
+            {
+                slot = boost;
+                tp = ORDER::getTask(boost);
+            }
+
+            if (tp && (boost>=0 || DISPATCH::canDispatch(slot)))
             {
-                TaskResult tres = tp->run(this);
+                uint8_t tasks;
+                TaskResult tres = dispatch(tp, slot, tasks);
                 if(tres>res)
                     res = tres;
-                TRACEF("SCH %d --> %s\n", taskIndex(tpp), toString(res) );
+                TRACEF("SCH %d --> %s\n", slot, toString(res) );
                 if(ORDER::CAN_CONTINUE && res== TaskResult::RunContinue)
                 {
-                    ORDER::continueFrom(tpp);
-                    break;
-                }                    
+                    if(DISPATCH::allowContinue(slot))
+                    {
+                        ORDER::continueFrom(tpp);
+                        break;
+                    }
+                    // continuation refused; carry on as if it had just run
+                    res = tres = TaskResult::Run;
+                }
                     
-                if(LIMIT::doneSlice(tres))
+                bool done = LIMIT::doneSlice(tres, *this) || doneNestedSlice(tres);
+
+                // a nested scheduler's tasks each count against our limits
+                for(uint8_t n=tasks; n>1 && !done; --n)
+                    done = LIMIT::doneSlice(TaskResult::Run, *this) || doneNestedSlice(TaskResult::Run);
+
+                if(done)
                     break;
             }
             tpp = ORDER::getNext(tpp);
         }
 
+        if(res==TaskResult::NotRun)
+            res = runDemoted();
+
+        LIMIT::endSlice(*this);
+        endNestedSlice(res);
         return res;
     }
     //----------------------------------------------------
@@ -284,6 +1138,149 @@ namespace psiiot
         
     };    
     //====================================================
+    /**
+     * One operating mode of a `ModeScheduler`. Declare modes `const`, like
+     * their task tables.
+     */
+    struct SchedulerMode
+    {
+        /// `N` slots to run in this mode
+        Task* const* table;
+
+        /// Slice time (ms), for timed LIMITs; 0 for the scheduler's default
+        uint16_t sliceMillis;
+
+        /// Task limit, for LIMITs based on `RunNTasks`; 0 for the scheduler's default
+        uint8_t taskLimit;
+
+        /// Called on entering the mode, e.g. to re-phase its timers; may be NULL
+        void (*onEnter)(const SchedulerMode& mode, uint32_t now);
+    };
+
+    //====================================================
+    /*!
+        Scheduler switching between predefined modes (sleep, active,
+        diagnostic...), each with its own task table, limits and entry
+        action.
+
+        `requestMode()` only records the mode wanted, and is safe from
+        ISRs; the switch itself happens at the start of the next slice, and
+        is just a table pointer swap plus the mode's settings. So a slice
+        always runs entirely in one mode.
+
+        Every mode sets the slice time and task limit in full: a 0 field
+        means the scheduler's default, i.e. its setting when constructed,
+        so entering a mode never depends on which mode came before.
+
+        For the same reason, switching to another mode resets the DISPATCH
+        trait: per-slot state and registrations (budgets, waits, resources,
+        continuation limits) belonged to the old table's tasks. Set up the
+        new mode's in its `onEnter`, which runs after the reset.
+
+        @code
+            Task* const activeTasks[] = { &sensors, &radio, &ui };
+            Task* const sleepTasks[] = { &radio, NULL, NULL };
+            const SchedulerMode active = { activeTasks, 10, 0, onActive };
+            const SchedulerMode asleep = { sleepTasks, 2, 0, NULL };
+
+            ModeScheduler<RunTasksTimed, 3> sch(active);
+            ...
+            sch.requestMode(asleep);
+        @endcode
+
+        @tparam ATOMIC  Protection for the mode request; an `AtomicBlock` type if requesting from ISRs
+     */
+    template<
+        class LIMIT,
+        uint8_t N,
+        class DISPATCH = DispatchAll,
+        typename ATOMIC = AtomicBlock<Atomic_RestoreState>
+        >
+    class ModeScheduler : public TaskScheduler<LIMIT, FromTable<N>, DISPATCH>
+    {
+        typedef TaskScheduler<LIMIT, FromTable<N>, DISPATCH> Base;
+
+        const SchedulerMode* mode_;                 ///< Current mode
+        const SchedulerMode* volatile pending_;     ///< Mode to switch to, if any
+        uint32_t defaultSlice_;                     ///< Slice time for modes giving 0
+        uint8_t defaultLimit_;                      ///< Task limit for modes giving 0
+
+        //----------------------------------------------------
+        static uint8_t getTaskLimit(RunNTasks* limit) { return limit->getMaxExecCount(); }
+        static uint8_t getTaskLimit(void* limit) { return 0; }
+
+        static void applyTaskLimit(RunNTasks* limit, uint8_t n) { limit->setLimit(n); }
+        static void applyTaskLimit(void* limit, uint8_t n) {}
+
+        //----------------------------------------------------
+        void enter(const SchedulerMode& m)
+        {
+            if(&m != mode_)
+                DISPATCH::reset();
+            mode_ = &m;
+            FromTable<N>::setTable(m.table);
+            this->setSliceMillis(m.sliceMillis ? m.sliceMillis : defaultSlice_);
+            applyTaskLimit(static_cast<LIMIT*>(this), m.taskLimit ? m.taskLimit : defaultLimit_);
+            if(m.onEnter)
+                m.onEnter(m, millis());
+        }
+
+    public:
+        //----------------------------------------------------
+        /// Starts in `initial`, which is entered on the first slice
+        explicit ModeScheduler(const SchedulerMode& initial)
+        : Base(initial.table), mode_(&initial), pending_(&initial),
+          defaultSlice_(this->getSliceMillis()),
+          defaultLimit_(getTaskLimit(static_cast<LIMIT*>(this)))
+        {}
+        //----------------------------------------------------
+        /// Switch to `m` at the start of the next slice; safe from ISRs
+        void requestMode(const SchedulerMode& m)
+        {
+            ATOMIC block;
+            pending_ = &m;
+        }
+        //----------------------------------------------------
+        /// Mode of the current (or last) slice
+        const SchedulerMode& getMode() const { return *mode_; }
+
+        /// `true` if a switch is waiting for the next slice
+        bool isModePending() const
+        {
+            ATOMIC block;
+            return pending_ != NULL;
+        }
+        //----------------------------------------------------
+        TaskResult run(ATaskScheduler* sch) override
+        {
+            const SchedulerMode* m;
+            {
+                ATOMIC block;
+                m = pending_;
+                pending_ = NULL;
+            }
+            if(m)
+                enter(*m);
+
+            return Base::run(sch);
+        }
+    };
+    //====================================================
+    // Traits are composed without virtual bases, so an empty trait costs
+    // nothing and a scheduler is just its base plus its slots.
+    static_assert(sizeof(RunAllTasks)==1 && sizeof(RunOneTask)==1 && sizeof(RunTasksTimed)==1,
+                    "stateless LIMIT traits must be empty");
+    static_assert(sizeof(RunNTasksTimed)==sizeof(RunNTasks),
+                    "SchedulerTraits must not add to its traits' size");
+    static_assert(sizeof(TryAllScheduler<8>)==sizeof(ATaskScheduler) + 8*sizeof(Task*),
+                    "TryAllScheduler has unexpected overhead");
+    static_assert(sizeof(FromFirstSharedScheduler<8>)==sizeof(ATaskScheduler) + 9*sizeof(Task*),
+                    "FromFirstSharedScheduler has unexpected overhead");
+    static_assert(sizeof(RoundRobinSharedScheduler<8>)==sizeof(ATaskScheduler) + 9*sizeof(Task*),
+                    "RoundRobinSharedScheduler has unexpected overhead");
+    static_assert(sizeof(TaskScheduler<RunAllTasks, FromTable<8> >)==sizeof(ATaskScheduler) + sizeof(Task*),
+                    "FromTable scheduler has unexpected overhead");
+    //====================================================
 }
 
 #endif
\ No newline at end of file
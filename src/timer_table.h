@@ -0,0 +1,230 @@
+/*! @file
+    @brief Structure-of-arrays timer table, for large numbers of timed tasks
+ */
+#ifndef TIMER_TABLE_H
+#define TIMER_TABLE_H
+
+#include "task.h"
+
+#ifndef ENABLE_TIMER_TABLE_SIMD
+#define ENABLE_TIMER_TABLE_SIMD 1
+#endif
+
+#if ENABLE_TIMER_TABLE_SIMD && defined(__AVX2__)
+#include <immintrin.h>
+#elif ENABLE_TIMER_TABLE_SIMD && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace psiiot
+{
+    //===================================================================
+    /**
+     * Timers for many plain `Task`s, kept apart from the tasks themselves.
+     *
+     * Deadlines and periods are held in arrays of their own, so finding
+     * which timers have expired reads a few contiguous cache lines rather
+     * than every task object. The scan yields a ready mask, 32 timers per
+     * word; on hosts it is done with SSE2 or AVX2 compares (set
+     * `ENABLE_TIMER_TABLE_SIMD` to 0 for the portable loop).
+     *
+     * Put the table in a scheduler slot in place of its tasks. Each slice it
+     * runs every task whose deadline has passed, in index order, stopping
+     * early if the slice budget is spent; tasks left over are still ready
+     * next slice. Cyclic timers are re-armed against their ideal phase, so
+     * there is no drift, and whole periods missed are skipped.
+     *
+     * The earliest deadline is cached, and only recomputed after a timer is
+     * armed, re-armed or stopped; until it passes, a slice skips the scan.
+     *
+     * @tparam N    Number of timers
+     */
+    template<unsigned N>
+    class TimerTable : public Task
+    {
+    public:
+        static const unsigned WORDS = (N+31)/32;
+
+    private:
+        // padded to whole mask words, so the scan needs no tail handling
+        uint32_t deadline_[WORDS*32];
+        uint32_t period_[WORDS*32];     ///< 0 = one-shot
+        Task* task_[WORDS*32];
+        uint32_t active_[WORDS];
+        uint32_t soonest_;          ///< Earliest active deadline, if `hasSoonest_`
+        bool hasSoonest_;
+        bool dirty_;                ///< `soonest_` needs recomputing
+
+        //----------------------------------------
+        /// Bit per timer in word `w` whose deadline is not after `now`
+        inline uint32_t expired(uint32_t now, unsigned w) const
+        {
+            const uint32_t* d = deadline_ + w*32;
+            uint32_t late = 0;  // sign bits of (now - deadline): set if not yet due
+
+#if ENABLE_TIMER_TABLE_SIMD && defined(__AVX2__)
+            const __m256i n = _mm256_set1_epi32(now);
+            for(unsigned k=0; k<4; ++k)
+            {
+                __m256i diff = _mm256_sub_epi32(n, _mm256_loadu_si256((const __m256i*)(d + k*8)));
+                late |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(diff)) << (k*8);
+            }
+#elif ENABLE_TIMER_TABLE_SIMD && defined(__SSE2__)
+            const __m128i n = _mm_set1_epi32(now);
+            for(unsigned k=0; k<8; ++k)
+            {
+                __m128i diff = _mm_sub_epi32(n, _mm_loadu_si128((const __m128i*)(d + k*4)));
+                late |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(diff)) << (k*4);
+            }
+#else
+            for(unsigned k=0; k<32; ++k)
+                late |= ((now - d[k]) >> 31) << k;
+#endif
+            return ~late;
+        }
+        //----------------------------------------
+        /// Re-arm timer `i`, which has expired by `now`
+        void rearm(unsigned i, uint32_t now)
+        {
+            const uint32_t p = period_[i];
+            dirty_ = true;
+            if(p==0)
+            {
+                active_[i/32] &= ~(1UL << (i%32));
+                return;
+            }
+
+            uint32_t d = deadline_[i] + p;
+            if((int32_t)(now - d) >= 0)
+                d += ((now - d)/p + 1) * p;    // skip whole periods missed
+            deadline_[i] = d;
+        }
+
+        //----------------------------------------
+        /// Re-arm and run the `ready` timers' tasks, until the slice budget is spent
+        TaskResult dispatch(ATaskScheduler* sch, uint32_t now, const uint32_t* ready)
+        {
+            TaskResult res = TaskResult::NotRun;
+            for(unsigned w=0; w<WORDS; ++w)
+            {
+                for(uint32_t bits=ready[w]; bits; bits &= bits-1)
+                {
+                    unsigned i = w*32;
+                    for(uint32_t b=bits; !(b&1); b>>=1)
+                        ++i;
+
+                    rearm(i, now);
+                    if(task_[i])
+                    {
+                        TaskResult r = task_[i]->run(sch);
+                        if(r>res)
+                            res = r;
+                    }
+
+                    if(sch->isSliceBudgetSpent())
+                        return res;
+                }
+            }
+            return res;
+        }
+
+    public:
+        //----------------------------------------
+        TimerTable()
+        : deadline_(), period_(), task_(), active_(), soonest_(0), hasSoonest_(false), dirty_(false)
+        {}
+        //----------------------------------------
+        /*!
+            Time `t` in timer `i`.
+            @param period   ms; 0 for a one-shot
+            @param first    Deadline of the first run
+         */
+        void set(unsigned i, Task* t, uint32_t period, uint32_t first)
+        {
+            task_[i] = t;
+            period_[i] = period;
+            deadline_[i] = first;
+            active_[i/32] |= 1UL << (i%32);
+            dirty_ = true;
+        }
+        //----------------------------------------
+        /// As `set()`, with the first run one period from now
+        void set(unsigned i, Task* t, uint32_t period)
+        {
+            set(i, t, period, millis() + period);
+        }
+        //----------------------------------------
+        void stop(unsigned i) { active_[i/32] &= ~(1UL << (i%32)); dirty_ = true; }
+
+        bool isActive(unsigned i) const { return active_[i/32] & (1UL << (i%32)); }
+
+        uint32_t getPeriod(unsigned i) const { return period_[i]; }
+        void setPeriod(unsigned i, uint32_t period) { period_[i] = period; }
+
+        uint32_t getDeadline(unsigned i) const { return deadline_[i]; }
+        Task* getTask(unsigned i) const { return task_[i]; }
+        //----------------------------------------
+        /*!
+            Find the active timers due by `now`.
+            @param ready[out]   `WORDS` words; bit `i%32` of word `i/32` set if timer `i` is due
+            @return `true` if any are
+         */
+        bool scan(uint32_t now, uint32_t* ready) const
+        {
+            uint32_t any = 0;
+            for(unsigned w=0; w<WORDS; ++w)
+            {
+                ready[w] = active_[w] ? expired(now, w) & active_[w] : 0;
+                any |= ready[w];
+            }
+            return any;
+        }
+        //----------------------------------------
+        /*!
+            Earliest deadline of the active timers, or `now` if one is overdue.
+            @return `false` if none are active
+         */
+        bool nextDeadline(uint32_t now, uint32_t& when)
+        {
+            if(dirty_)
+            {
+                // deadlines are all within 2^31 ms of each other, so compare by difference
+                hasSoonest_ = false;
+                for(unsigned w=0; w<WORDS; ++w)
+                {
+                    for(uint32_t bits=active_[w]; bits; bits &= bits-1)
+                    {
+                        unsigned i = w*32;
+                        for(uint32_t b=bits; !(b&1); b>>=1)
+                            ++i;
+                        if(!hasSoonest_ || (int32_t)(deadline_[i] - soonest_) < 0)
+                            soonest_ = deadline_[i];
+                        hasSoonest_ = true;
+                    }
+                }
+                dirty_ = false;
+            }
+
+            when = (int32_t)(soonest_ - now) < 0 ? now : soonest_;
+            return hasSoonest_;
+        }
+        //----------------------------------------
+        TaskResult run(ATaskScheduler* sch) override
+        {
+            const uint32_t now = sch->sliceBeginMillis();
+            uint32_t ready[WORDS];
+            TaskResult res = TaskResult::NotRun;
+
+            // nothing can have expired before the earliest deadline
+            uint32_t when;
+            if(nextDeadline(now, when) && when==now && scan(now, ready))
+                res = dispatch(sch, now, ready);
+
+            if(nextDeadline(now, when))
+                sch->proposeWake(when);
+            return res;
+        }
+    };
+    //===================================================================
+}
+#endif
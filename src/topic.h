@@ -0,0 +1,168 @@
+/*! @file
+    @brief Publish/subscribe topic: one ring, many readers
+ */
+#ifndef TOPIC_H
+#define TOPIC_H
+
+#include "event_group.h"
+
+namespace psiiot
+{
+    //===================================================================
+    /// A subscriber's read position in a `Topic`
+    struct Subscription
+    {
+        uint32_t next;      ///< Sequence number of the next sample to read
+        uint32_t overruns;  ///< Samples lost because the publisher lapped us
+
+        Subscription() : next(0), overruns(0) {}
+    };
+    //===================================================================
+    /**
+     * Topic bus: a publisher writes each sample once, into a ring shared by
+     * all subscribers.
+     *
+     * Each subscriber keeps its own `Subscription` cursor and reads samples
+     * in place. The publisher never waits: a subscriber that falls more than
+     * `N-1` samples behind skips ahead to the oldest sample still held, and
+     * the samples it missed are added to its `overruns`.
+     *
+     * For wakeups, give the topic an `EventGroup` and each subscriber a bit;
+     * every publish sets the subscribers' bits, so subscriber tasks waiting
+     * through `WaitForEvents` (with clear-on-wake) are only dispatched when
+     * there is data. A woken subscriber should read everything available.
+     *
+     * @code
+     *      Topic<Sample, 8, AtomicBlock<Atomic_RestoreState> > samples;
+     *      ...
+     *      Sample& s = samples.claim();     // publisher
+     *      s.value = adc;
+     *      samples.publish();
+     *      ...
+     *      Sample v;                        // subscriber
+     *      while(samples.read(sub_, v))
+     *          log(v);
+     * @endcode
+     *
+     * @tparam T        Sample type
+     * @tparam N        Ring length; a power of 2
+     * @tparam ATOMIC   Protection for the sequence counter; an `AtomicBlock` type if publishing from ISRs
+     */
+    template<class T, unsigned N, typename ATOMIC = UnsafeBlock>
+    class Topic
+    {
+        static_assert(N >= 2 && (N & (N-1)) == 0, "Topic length must be a power of 2");
+
+        T ring_[N];
+        uint32_t seq_;                  ///< Samples published so far
+        EventGroup<ATOMIC>* group_;     ///< Where to signal subscribers
+        EventBits wake_;                ///< Subscribers' bits in `group_`
+
+        //----------------------------------------
+        inline uint32_t seq() const
+        {
+            ATOMIC block;
+            return seq_;
+        }
+
+    public:
+        //----------------------------------------
+        Topic()
+        : ring_(), seq_(0), group_(NULL), wake_(0)
+        {}
+        //----------------------------------------
+        /// Signal subscribers through `g`
+        void setEvents(EventGroup<ATOMIC>& g) { group_ = &g; }
+        //----------------------------------------
+        /*!
+            Start reading at the next sample published.
+            @param bit  This subscriber's bit in the topic's `EventGroup`, or 0
+         */
+        void subscribe(Subscription& s, EventBits bit=0)
+        {
+            s.next = seq();
+            s.overruns = 0;
+            wake_ |= bit;
+        }
+        //----------------------------------------
+        void unsubscribe(EventBits bit) { wake_ &= ~bit; }
+        //----------------------------------------
+        /// Publisher: the slot for the next sample, to fill in place
+        T& claim() { return ring_[seq_ & (N-1)]; }
+        //----------------------------------------
+        /// Publisher: make the claimed sample visible, and signal subscribers
+        void publish()
+        {
+            {
+                ATOMIC block;
+                ++seq_;
+            }
+            if(group_ && wake_)
+                group_->set(wake_);
+        }
+        //----------------------------------------
+        /// Publisher: copy in and publish `v`
+        void publish(const T& v)
+        {
+            claim() = v;
+            publish();
+        }
+        //----------------------------------------
+        /// Samples published so far
+        uint32_t published() const { return seq(); }
+        //----------------------------------------
+        /// Samples `s` has not read yet
+        unsigned available(const Subscription& s) const
+        {
+            uint32_t n = seq() - s.next;
+            return n < N ? n : N-1;
+        }
+        //----------------------------------------
+        /*!
+            The oldest sample `s` has not read, in place; skips ahead past
+            samples already overwritten.
+            @return NULL if none
+         */
+        const T* peek(Subscription& s) const
+        {
+            uint32_t n = seq() - s.next;
+            if(n==0)
+                return NULL;
+
+            if(n >= N)
+            {
+                s.overruns += n - (N-1);
+                s.next += n - (N-1);
+            }
+            return &ring_[s.next & (N-1)];
+        }
+        //----------------------------------------
+        /*!
+            Done with the sample from `peek()`.
+            @return `false` if the publisher overwrote it meanwhile; it then counts as an overrun
+         */
+        bool release(Subscription& s) const
+        {
+            bool ok = seq() - s.next < N;
+            if(!ok)
+                ++s.overruns;
+            ++s.next;
+            return ok;
+        }
+        //----------------------------------------
+        /// Copy out the oldest unread sample; `false` if none
+        bool read(Subscription& s, T& v) const
+        {
+            const T* p;
+            while((p = peek(s)) != NULL)
+            {
+                v = *p;
+                if(release(s))
+                    return true;
+            }
+            return false;
+        }
+    };
+    //===================================================================
+}
+#endif
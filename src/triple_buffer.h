@@ -0,0 +1,99 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <AtomicBlock.h>
+
+namespace psiiot
+{
+
+/**
+ * Latest-value triple buffer.
+ *
+ * Shares a state struct between one writer and one reader (e.g. an ISR
+ * and a task) when only the newest value matters. The writer fills the
+ * back buffer in place and `publish()`es it; the reader gets the newest
+ * published value with `read()`, and it stays stable until the reader
+ * next calls `read()`. Neither side ever waits on, or copies, the other.
+ *
+ * The only shared state is one byte, swapped atomically; that is a
+ * handful of instructions, never a copy of `T`. Where the compiler has
+ * lock-free byte atomics (ARM, ESP, hosts) the swap is a single atomic
+ * exchange, with acquire/release ordering; otherwise (AVR) it is done
+ * under `ATOMIC`, between compiler barriers so that no access to the
+ * buffers is moved across it.
+ */
+template<
+        class T,
+        typename ATOMIC = AtomicBlock<Atomic_RestoreState>
+        >
+class TripleBuffer
+{
+    static const uint8_t INDEX = 0x03;
+    static const uint8_t FRESH = 0x04;     ///< Middle holds an unread value
+
+    T buf_[3];
+    uint8_t back_;              ///< Writer's buffer
+    uint8_t front_;             ///< Reader's buffer
+    volatile uint8_t middle_;   ///< Last published buffer, and FRESH
+
+    //----------------------------------------
+    inline uint8_t exchange(uint8_t v)
+    {
+#if defined(__GCC_ATOMIC_CHAR_LOCK_FREE) && __GCC_ATOMIC_CHAR_LOCK_FREE == 2
+        return __atomic_exchange_n(&middle_, v, __ATOMIC_ACQ_REL);
+#else
+        uint8_t old;
+        __asm__ __volatile__("" ::: "memory");
+        {
+            ATOMIC block;
+            old = middle_;
+            middle_ = v;
+        }
+        __asm__ __volatile__("" ::: "memory");
+        return old;
+#endif
+    }
+
+public:
+    //----------------------------------------
+    TripleBuffer()
+    : buf_(), back_(0), front_(1), middle_(2)
+    {
+    }
+    //----------------------------------------
+    /// Writer: the buffer to fill in
+    T& back() { return buf_[back_]; }
+    //----------------------------------------
+    /// Writer: make the back buffer the newest value
+    void publish()
+    {
+        back_ = exchange(back_ | FRESH) & INDEX;
+    }
+    //----------------------------------------
+    /// Writer: copy in and publish `v`
+    void write(const T& v)
+    {
+        buf_[back_] = v;
+        publish();
+    }
+    //----------------------------------------
+    /// Reader: `true` if a value was published since the last `read()`
+    bool hasNew() const { return middle_ & FRESH; }
+    //----------------------------------------
+    /// Reader: the newest published value
+    const T& read()
+    {
+        if(middle_ & FRESH)
+            front_ = exchange(front_) & INDEX;
+        return buf_[front_];
+    }
+    //----------------------------------------
+    /// Reader: the value returned by the last `read()`
+    const T& front() const { return buf_[front_]; }
+    //----------------------------------------
+};
+//==============================================================
+
+} //namespace
+
+#endif